@@ -4,13 +4,19 @@
 #include <list>
 #include <map>
 #include <set>
+#include <algorithm>
 
 #include <boost/program_options.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 
 #include <components/esm/esmreader.hpp>
 #include <components/esm/esmwriter.hpp>
 #include <components/esm/records.hpp>
 
+#include <components/loadinglistener/loadinglistener.hpp>
+
+#include "../openmw/mwworld/esmstore.hpp"
+
 #include "record.hpp"
 
 #define ESMTOOL_VERSION 1.2
@@ -52,12 +58,17 @@ struct Arguments
     unsigned int quiet_given;
     unsigned int loadcells_given;
     bool plain_given;
+    bool store_given;
+
+    unsigned int repeat;
+    unsigned int threads;
 
     std::string mode;
     std::string encoding;
     std::string filename;
     std::string outname;
 
+    std::vector<std::string> files;
     std::vector<std::string> types;
 
     ESMData data;
@@ -67,7 +78,7 @@ struct Arguments
 
 bool parseOptions (int argc, char** argv, Arguments &info)
 {
-    bpo::options_description desc("Inspect and extract from Morrowind ES files (ESM, ESP, ESS)\nSyntax: esmtool [options] mode infile [outfile]\nAllowed modes:\n  dump\t Dumps all readable data from the input file.\n  clone\t Clones the input file to the output file.\n  comp\t Compares the given files.\n\nAllowed options");
+    bpo::options_description desc("Inspect and extract from Morrowind ES files (ESM, ESP, ESS)\nSyntax: esmtool [options] mode infile [outfile]\nAllowed modes:\n  dump\t Dumps all readable data from the input file.\n  clone\t Clones the input file to the output file.\n  comp\t Compares the given files.\n  bench\t Measures how fast the given files are parsed.\n\nAllowed options");
 
     desc.add_options()
         ("help,h", "print help message.")
@@ -83,6 +94,13 @@ bool parseOptions (int argc, char** argv, Arguments &info)
          "Only affects dump mode.")
         ("quiet,q", "Supress all record information. Useful for speed tests.")
         ("loadcells,C", "Browse through contents of all cells.")
+        ("repeat,n", bpo::value<unsigned int>(&(info.repeat))->default_value(5),
+         "Number of passes over the input files. Only affects bench mode.")
+        ("store,s", "Load the input files into the record store of the game, "
+         "including merging records. Only affects bench mode.")
+        ("threads,j", bpo::value<unsigned int>(&(info.threads))->default_value(1),
+         "Number of threads used with --store (0 = one per CPU core). "
+         "Only affects bench mode.")
 
         ( "encoding,e", bpo::value<std::string>(&(info.encoding))->
           default_value("win1252"),
@@ -103,7 +121,7 @@ bool parseOptions (int argc, char** argv, Arguments &info)
         ;
 
     bpo::positional_options_description p;
-    p.add("mode", 1).add("input-file", 2);
+    p.add("mode", 1).add("input-file", -1);
 
     // there might be a better way to do this
     bpo::options_description all;
@@ -151,7 +169,7 @@ bool parseOptions (int argc, char** argv, Arguments &info)
       info.types = variables["type"].as< std::vector<std::string> >();
 
     info.mode = variables["mode"].as<std::string>();
-    if (!(info.mode == "dump" || info.mode == "clone" || info.mode == "comp"))
+    if (!(info.mode == "dump" || info.mode == "clone" || info.mode == "comp" || info.mode == "bench"))
     {
         std::cout << std::endl << "ERROR: invalid mode \"" << info.mode << "\"" << std::endl << std::endl
                   << desc << finalText << std::endl;
@@ -173,7 +191,8 @@ bool parseOptions (int argc, char** argv, Arguments &info)
       return false;
       }*/
 
-    info.filename = variables["input-file"].as< std::vector<std::string> >()[0];
+    info.files = variables["input-file"].as< std::vector<std::string> >();
+    info.filename = info.files[0];
     if (variables["input-file"].as< std::vector<std::string> >().size() > 1)
         info.outname = variables["input-file"].as< std::vector<std::string> >()[1];
 
@@ -181,6 +200,10 @@ bool parseOptions (int argc, char** argv, Arguments &info)
     info.quiet_given = variables.count ("quiet");
     info.loadcells_given = variables.count ("loadcells");
     info.plain_given = (variables.count("plain") > 0);
+    info.store_given = (variables.count("store") > 0);
+
+    if (info.repeat == 0)
+        info.repeat = 1;
 
     // Font encoding settings
     info.encoding = variables["encoding"].as<std::string>();
@@ -200,6 +223,7 @@ void loadCell(ESM::Cell &cell, ESM::ESMReader &esm, Arguments& info);
 int load(Arguments& info);
 int clone(Arguments& info);
 int comp(Arguments& info);
+int bench(Arguments& info);
 
 int main(int argc, char**argv)
 {
@@ -213,6 +237,8 @@ int main(int argc, char**argv)
         return clone(info);
     else if (info.mode == "comp")
         return comp(info);
+    else if (info.mode == "bench")
+        return bench(info);
     else
     {
         std::cout << "Invalid or no mode specified, dying horribly. Have a nice day." << std::endl;
@@ -554,5 +580,231 @@ int comp(Arguments& info)
 
 
 
+    return 0;
+}
+
+namespace
+{
+    struct BenchStats
+    {
+        int mCount;
+        uint64_t mBytes;
+        double mSeconds;
+
+        BenchStats() : mCount(0), mBytes(0), mSeconds(0) {}
+    };
+
+    class SilentListener : public Loading::Listener
+    {
+    public:
+        virtual void setLabel (const std::string& label) {}
+        virtual void loadingOn() {}
+        virtual void loadingOff() {}
+        virtual void indicateProgress () {}
+        virtual void setProgressRange (size_t range) {}
+        virtual void setProgress (size_t value) {}
+        virtual void increaseProgress (size_t increase) {}
+        virtual void removeWallpaper() {}
+    };
+
+    double secondsSince(const boost::posix_time::ptime& start)
+    {
+        boost::posix_time::time_duration elapsed =
+            boost::posix_time::microsec_clock::universal_time() - start;
+        return elapsed.total_microseconds() / 1000000.0;
+    }
+
+    double megabytesPerSecond(uint64_t bytes, double seconds)
+    {
+        return seconds > 0 ? bytes / (1024.0 * 1024.0) / seconds : 0;
+    }
+
+    // Parse every record of one file, like dump --quiet does
+    void benchRecords(const std::string& filename, ToUTF8::Utf8Encoder& encoder,
+        std::map<int, BenchStats>& stats, Arguments& info)
+    {
+        ESM::ESMReader esm;
+        esm.setEncoder(&encoder);
+        esm.open(filename);
+
+        while(esm.hasMoreRecs())
+        {
+            boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+            uint64_t offset = esm.getOffset();
+
+            ESM::NAME n = esm.getRecName();
+            uint32_t flags;
+            esm.getRecHeader(flags);
+
+            std::string id = esm.getHNOString("NAME");
+            if (id.empty())
+                id = esm.getHNOString("INAM");
+
+            EsmTool::RecordBase *record = EsmTool::RecordBase::create(n);
+
+            if (record == 0) {
+                esm.skipRecord();
+            } else {
+                if (record->getType().val == ESM::REC_GMST) {
+                    record->cast<ESM::GameSetting>()->get().mId = id;
+                }
+                record->setId(id);
+                record->setFlags((int) flags);
+                record->load(esm);
+
+                if (record->getType().val == ESM::REC_CELL && info.loadcells_given) {
+                    loadCell(record->cast<ESM::Cell>()->get(), esm, info);
+                }
+
+                delete record;
+            }
+
+            BenchStats& entry = stats[n.val];
+            ++entry.mCount;
+            entry.mBytes += esm.getOffset() - offset;
+            entry.mSeconds += secondsSince(start);
+        }
+    }
+
+    // Count the records of one file without parsing them
+    void listRecords(const std::string& filename, std::map<int, BenchStats>& stats)
+    {
+        ESM::ESMReader esm;
+        esm.open(filename);
+
+        while(esm.hasMoreRecs())
+        {
+            uint64_t offset = esm.getOffset();
+
+            ESM::NAME n = esm.getRecName();
+            esm.getRecHeader();
+            esm.skipRecord();
+
+            BenchStats& entry = stats[n.val];
+            ++entry.mCount;
+            entry.mBytes += esm.getOffset() - offset;
+        }
+    }
+
+    // Load all files into a fresh ESMStore, the way the game does
+    void benchStore(const std::vector<std::string>& files, ToUTF8::Utf8Encoder& encoder,
+        unsigned int threads)
+    {
+        MWWorld::ESMStore store;
+        std::vector<ESM::ESMReader> readers(files.size());
+        std::vector<ESM::ESMReader *> pending;
+        SilentListener listener;
+
+        for (size_t i = 0; i < files.size(); ++i)
+        {
+            ESM::ESMReader& esm = readers[i];
+            esm.setEncoder(&encoder);
+            esm.setIndex(i);
+            esm.setGlobalReaderList(&readers);
+            esm.open(files[i]);
+
+            if (threads == 1)
+                store.load(esm, &listener);
+            else
+                pending.push_back(&esm);
+        }
+
+        if (!pending.empty())
+            store.load(pending, &listener, threads);
+
+        store.setUp();
+    }
+}
+
+int bench(Arguments& info)
+{
+    ToUTF8::Utf8Encoder encoder (ToUTF8::calculateEncoding(info.encoding));
+
+    // quiet loadCell()
+    info.quiet_given = 1;
+
+    std::map<int, BenchStats> stats;
+    std::vector<double> passes;
+
+    try {
+        for (unsigned int pass = 0; pass < info.repeat; ++pass)
+        {
+            boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+
+            if (info.store_given)
+            {
+                benchStore(info.files, encoder, info.threads);
+            }
+            else
+            {
+                for (std::vector<std::string>::const_iterator it = info.files.begin(); it != info.files.end(); ++it)
+                    benchRecords(*it, encoder, stats, info);
+            }
+
+            passes.push_back(secondsSince(start));
+            std::cout << "Pass " << pass + 1 << ": " << passes.back() * 1000 << " ms" << std::endl;
+        }
+
+        // The store does not time record types individually
+        if (info.store_given)
+        {
+            for (std::vector<std::string>::const_iterator it = info.files.begin(); it != info.files.end(); ++it)
+                listRecords(*it, stats);
+        }
+    } catch(std::exception &e) {
+        std::cout << "\nERROR:\n\n  " << e.what() << std::endl;
+        return 1;
+    }
+
+    // Counts and bytes are per pass, times summed over all passes
+    int passCount = info.store_given ? 1 : info.repeat;
+
+    std::cout << std::endl << std::fixed << std::setprecision(2)
+              << "Type     Count       Bytes";
+    if (!info.store_given)
+        std::cout << "     Time (ms)      MB/s";
+    std::cout << std::endl;
+
+    BenchStats total;
+    ESM::NAME name;
+    for (std::map<int, BenchStats>::const_iterator it = stats.begin(); it != stats.end(); ++it)
+    {
+        const BenchStats& entry = it->second;
+        name.val = it->first;
+
+        std::cout << name.toString()
+                  << std::setw(10) << entry.mCount / passCount
+                  << std::setw(12) << entry.mBytes / passCount;
+        if (!info.store_given)
+            std::cout << std::setw(14) << entry.mSeconds * 1000
+                      << std::setw(10) << megabytesPerSecond(entry.mBytes, entry.mSeconds);
+        std::cout << std::endl;
+
+        total.mCount += entry.mCount;
+        total.mBytes += entry.mBytes;
+        total.mSeconds += entry.mSeconds;
+    }
+
+    std::cout << "Total" << std::setw(9) << total.mCount / passCount
+              << std::setw(12) << total.mBytes / passCount;
+    if (!info.store_given)
+        std::cout << std::setw(14) << total.mSeconds * 1000
+                  << std::setw(10) << megabytesPerSecond(total.mBytes, total.mSeconds);
+    std::cout << std::endl;
+
+    std::sort(passes.begin(), passes.end());
+
+    uint64_t bytes = total.mBytes / passCount;
+    double median = passes[passes.size() / 2];
+
+    std::cout << std::endl
+              << info.repeat << " passes over " << info.files.size() << " file(s)"
+              << (info.store_given ? " into the record store" : "") << ":" << std::endl
+              << "  min    " << passes.front() * 1000 << " ms" << std::endl
+              << "  median " << median * 1000 << " ms" << std::endl
+              << "  90%    " << passes[(passes.size() - 1) * 9 / 10] * 1000 << " ms" << std::endl
+              << "  max    " << passes.back() * 1000 << " ms" << std::endl
+              << "  " << megabytesPerSecond(bytes, median) << " MB/s at the median" << std::endl;
+
     return 0;
 }
@@ -0,0 +1,336 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <exception>
+
+#include <boost/program_options.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/format.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include <OgreRoot.h>
+#include <OgreLogManager.h>
+#include <OgreResourceGroupManager.h>
+
+#include <components/bsa/vfs.hpp>
+#include <components/bsa/bsa_archive.hpp>
+#include <components/nif/niffile.hpp>
+#include <components/nif/record.hpp>
+#include <components/nifbullet/bulletnifloader.hpp>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+// Create local aliases for brevity
+namespace bpo = boost::program_options;
+namespace bfs = boost::filesystem;
+
+struct Arguments
+{
+    std::vector<std::string> inputs;
+    unsigned int repeat;
+    unsigned int slowest;
+    bool bullet;
+    bool verbose;
+};
+
+bool parseOptions (int argc, char** argv, Arguments &info)
+{
+    bpo::options_description desc("Parse all NIF files in BSA archives and data directories\n\n"
+            "Usages:\n"
+            "  niftest [options] archive_or_directory...\n"
+            "      Parse every .nif and .kf file, and report times, record types and failures.\n"
+            "      Later archives and directories override earlier ones, loose files\n"
+            "      override archives, like in the game.\n\n"
+            "Allowed options");
+
+    desc.add_options()
+        ("help,h", "print help message.")
+        ("repeat,n", bpo::value<unsigned int>(&info.repeat)->default_value(1),
+            "parse all files this many times, and report the spread of the passes.")
+        ("bullet,b", "also convert every file to a Bullet collision shape.")
+        ("slowest,s", bpo::value<unsigned int>(&info.slowest)->default_value(10),
+            "list this many of the slowest files.")
+        ("verbose,v", "print the time of every file.")
+        ;
+
+    // input-file is hidden and used as a positional argument
+    bpo::options_description hidden("Hidden Options");
+
+    hidden.add_options()
+        ( "input-file,i", bpo::value< std::vector<std::string> >(&info.inputs), "input file")
+        ;
+
+    bpo::positional_options_description p;
+    p.add("input-file", -1);
+
+    bpo::options_description all;
+    all.add(desc).add(hidden);
+
+    bpo::variables_map variables;
+    try
+    {
+        bpo::parsed_options valid_opts = bpo::command_line_parser(argc, argv)
+            .options(all).positional(p).run();
+        bpo::store(valid_opts, variables);
+        bpo::notify(variables);
+    }
+    catch(std::exception &e)
+    {
+        std::cout << "ERROR parsing arguments: " << e.what() << "\n\n"
+                  << desc << std::endl;
+        return false;
+    }
+
+    if (variables.count ("help") || info.inputs.empty())
+    {
+        std::cout << desc << std::endl;
+        return false;
+    }
+
+    if (info.repeat == 0)
+        info.repeat = 1;
+
+    info.bullet = variables.count("bullet") != 0;
+    info.verbose = variables.count("verbose") != 0;
+
+    return true;
+}
+
+namespace
+{
+    struct FileStats
+    {
+        std::string mName;
+        size_t mBytes;
+        double mSeconds; // over all passes
+        std::string mError;
+
+        FileStats() : mBytes(0), mSeconds(0) {}
+
+        static bool compareNames(const FileStats& left, const FileStats& right)
+        {
+            return left.mName < right.mName;
+        }
+
+        // Slowest first
+        static bool compareTimes(const FileStats& left, const FileStats& right)
+        {
+            return left.mSeconds > right.mSeconds;
+        }
+    };
+
+    double secondsSince(const boost::posix_time::ptime& start)
+    {
+        boost::posix_time::time_duration elapsed =
+            boost::posix_time::microsec_clock::universal_time() - start;
+        return elapsed.total_microseconds() / 1000000.0;
+    }
+
+    double megabytesPerSecond(size_t bytes, double seconds)
+    {
+        return seconds > 0 ? bytes / (1024.0 * 1024.0) / seconds : 0;
+    }
+
+    /// Peak resident memory of this process in bytes, or 0 if unknown
+    size_t peakMemory()
+    {
+#ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS counters;
+        if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+            return counters.PeakWorkingSetSize;
+        return 0;
+#else
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) != 0)
+            return 0;
+#ifdef __APPLE__
+        return usage.ru_maxrss;
+#else
+        return usage.ru_maxrss * 1024;
+#endif
+#endif
+    }
+
+    bool isNif(const std::string& name)
+    {
+        std::string::size_type extpos = name.rfind('.');
+        if (extpos == std::string::npos)
+            return false;
+
+        std::string ext = name.substr(extpos);
+        return ext == ".nif" || ext == ".kf";
+    }
+
+    /// Parse \a file once, and convert it to a Bullet shape if \a loader is given.
+    void parseFile(FileStats& file, std::map<std::string, size_t>* histogram,
+        NifBullet::ManualBulletShapeLoader* loader)
+    {
+        boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+
+        try
+        {
+            Nif::NIFFile::ptr nif = Nif::NIFFile::create(file.mName);
+
+            if (loader)
+            {
+                // Same naming as the physics system uses, for a scale of 1
+                std::string shape = file.mName + (boost::format("%07.3f") % 1.0f).str();
+                std::string group = Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME;
+
+                loader->load(shape, group);
+                OEngine::Physic::BulletShapeManager::getSingleton().load(shape, group);
+                OEngine::Physic::BulletShapeManager::getSingleton().remove(shape);
+            }
+
+            file.mSeconds += secondsSince(start);
+
+            if (histogram)
+            {
+                for (size_t i = 0; i < nif->numRecords(); ++i)
+                    ++(*histogram)[nif->getRecord(i)->recName];
+            }
+        }
+        catch (std::exception& e)
+        {
+            file.mSeconds += secondsSince(start);
+            file.mError = e.what();
+        }
+    }
+}
+
+int main(int argc, char**argv)
+{
+    Arguments info;
+    if (!parseOptions (argc, argv, info))
+        return 1;
+
+    // Ogre is only needed for its resource system; keep its log quiet
+    Ogre::LogManager logManager;
+    logManager.createLog("niftest.log", true, false, true);
+    Ogre::Root root("", "", "");
+
+    OEngine::Physic::BulletShapeManager *shapeManager = 0;
+    NifBullet::ManualBulletShapeLoader loader;
+    if (info.bullet)
+        shapeManager = new OEngine::Physic::BulletShapeManager;
+
+    Bsa::VFS vfs;
+    try
+    {
+        for (std::vector<std::string>::const_iterator it = info.inputs.begin(); it != info.inputs.end(); ++it)
+        {
+            if (bfs::is_directory(*it))
+                vfs.addDir(*it, false);
+            else
+                vfs.addBSA(*it);
+        }
+    }
+    catch (std::exception& e)
+    {
+        std::cerr << "ERROR reading input: " << e.what() << std::endl;
+        return 1;
+    }
+
+    Bsa::addVFS(vfs, Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
+
+    std::vector<FileStats> files;
+    for (Bsa::VFS::Index::const_iterator it = vfs.begin(); it != vfs.end(); ++it)
+    {
+        if (!isNif(it->first))
+            continue;
+
+        FileStats file;
+        file.mName = it->first;
+        file.mBytes = vfs.open(it->first)->size();
+        files.push_back(file);
+    }
+
+    // Same order on every run, independent of the hash table
+    std::sort(files.begin(), files.end(), FileStats::compareNames);
+
+    size_t bytes = 0;
+    for (std::vector<FileStats>::const_iterator it = files.begin(); it != files.end(); ++it)
+        bytes += it->mBytes;
+
+    std::map<std::string, size_t> histogram;
+    std::vector<double> passes;
+
+    for (unsigned int pass = 0; pass < info.repeat; ++pass)
+    {
+        boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+
+        for (std::vector<FileStats>::iterator it = files.begin(); it != files.end(); ++it)
+            parseFile(*it, pass == 0 ? &histogram : 0, info.bullet ? &loader : 0);
+
+        passes.push_back(secondsSince(start));
+    }
+
+    std::cout << std::fixed << std::setprecision(2);
+
+    if (info.verbose)
+    {
+        for (std::vector<FileStats>::const_iterator it = files.begin(); it != files.end(); ++it)
+            std::cout << std::setw(10) << it->mSeconds * 1000 / info.repeat << " ms"
+                      << std::setw(10) << it->mBytes << "  " << it->mName << std::endl;
+        std::cout << std::endl;
+    }
+
+    // Record types, most common first
+    std::vector<std::pair<size_t, std::string> > types;
+    for (std::map<std::string, size_t>::const_iterator it = histogram.begin(); it != histogram.end(); ++it)
+        types.push_back(std::make_pair(it->second, it->first));
+    std::sort(types.rbegin(), types.rend());
+
+    std::cout << "Record type                        Count" << std::endl;
+    for (size_t i = 0; i < types.size(); ++i)
+        std::cout << std::left << std::setw(30) << types[i].second
+                  << std::right << std::setw(11) << types[i].first << std::endl;
+
+    std::vector<FileStats> failed;
+    for (std::vector<FileStats>::const_iterator it = files.begin(); it != files.end(); ++it)
+        if (!it->mError.empty())
+            failed.push_back(*it);
+
+    std::vector<FileStats> slowest(files);
+    std::sort(slowest.begin(), slowest.end(), FileStats::compareTimes);
+    slowest.resize(std::min<size_t>(slowest.size(), info.slowest));
+
+    std::cout << std::endl << "Slowest files:" << std::endl;
+    for (std::vector<FileStats>::const_iterator it = slowest.begin(); it != slowest.end(); ++it)
+        std::cout << std::setw(10) << it->mSeconds * 1000 / info.repeat << " ms  " << it->mName << std::endl;
+
+    if (!failed.empty())
+    {
+        std::cout << std::endl << failed.size() << " file(s) failed:" << std::endl;
+        for (std::vector<FileStats>::const_iterator it = failed.begin(); it != failed.end(); ++it)
+            std::cout << it->mName << ": " << it->mError << std::endl;
+    }
+
+    std::sort(passes.begin(), passes.end());
+    double median = passes[passes.size() / 2];
+
+    std::cout << std::endl
+              << info.repeat << " pass(es) over " << files.size() << " file(s), "
+              << bytes / (1024.0 * 1024.0) << " MB"
+              << (info.bullet ? " with Bullet shapes" : "") << ":" << std::endl
+              << "  min    " << passes.front() * 1000 << " ms" << std::endl
+              << "  median " << median * 1000 << " ms" << std::endl
+              << "  90%    " << passes[(passes.size() - 1) * 9 / 10] * 1000 << " ms" << std::endl
+              << "  max    " << passes.back() * 1000 << " ms" << std::endl
+              << "  " << megabytesPerSecond(bytes, median) << " MB/s at the median" << std::endl;
+
+    size_t peak = peakMemory();
+    if (peak > 0)
+        std::cout << "  peak memory " << peak / (1024.0 * 1024.0) << " MB" << std::endl;
+
+    delete shapeManager;
+
+    return failed.empty() ? 0 : 1;
+}
@@ -215,13 +215,13 @@ CSMDoc::WriteFilterStage::WriteFilterStage (Document& document, SavingState& sta
   mDocument (document), mScope (scope)
 {}
 
-void CSMDoc::WriteFilterStage::perform (int stage, std::vector<std::string>& messages)
+void CSMDoc::WriteFilterStage::writeRecord (ESM::ESMWriter& writer, int index) const
 {
     const CSMWorld::Record<CSMFilter::Filter>& record =
-        mDocument.getData().getFilters().getRecord (stage);
+        mDocument.getData().getFilters().getRecord (index);
 
     if (record.get().mScope==mScope)
-        WriteCollectionStage<CSMWorld::IdCollection<CSMFilter::Filter> >::perform (stage, messages);
+        WriteCollectionStage<CSMWorld::IdCollection<CSMFilter::Filter> >::writeRecord (writer, index);
 }
 
 
@@ -1,6 +1,14 @@
 #ifndef CSM_DOC_SAVINGSTAGES_H
 #define CSM_DOC_SAVINGSTAGES_H
 
+#include <algorithm>
+#include <stdexcept>
+
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
+#include <QSemaphore>
+
 #include "stage.hpp"
 
 #include "../world/record.hpp"
@@ -65,11 +73,45 @@ namespace CSMDoc
     template<class CollectionT>
     class WriteCollectionStage : public Stage
     {
+            /// Serialises a range of records on a worker thread
+            class WriteTask : public QRunnable
+            {
+                    WriteCollectionStage& mStage;
+                    ToUTF8::Utf8Encoder mEncoder;
+                    int mBegin;
+                    int mEnd;
+                    std::string& mError;
+                    QSemaphore& mDone; // released when the task has finished
+
+                public:
+
+                    WriteTask (WriteCollectionStage& stage, int begin, int end, std::string& error,
+                        QSemaphore& done);
+
+                    virtual void run();
+            };
+
+            friend class WriteTask;
+
             const CollectionT& mCollection;
             SavingState& mState;
+            std::vector<std::string> mBuffers; // serialised records of the current batch
+
+            void serialise (int begin, int end);
+            ///< Serialise records \a begin to \a end-1 into mBuffers.
+
+        protected:
+
+            virtual void writeRecord (ESM::ESMWriter& writer, int index) const;
+            ///< Serialise record \a index, if it needs to be saved.
+            ///
+            /// \note Called from worker threads.
 
         public:
 
+            /// Number of records that are serialised together
+            static const int sBatchSize = 256;
+
             WriteCollectionStage (const CollectionT& collection, SavingState& state);
 
             virtual int setup();
@@ -79,6 +121,36 @@ namespace CSMDoc
             ///< Messages resulting from this stage will be appended to \a messages.
     };
 
+    template<class CollectionT>
+    WriteCollectionStage<CollectionT>::WriteTask::WriteTask (WriteCollectionStage& stage,
+        int begin, int end, std::string& error, QSemaphore& done)
+    : mStage (stage), mEncoder (*stage.mState.getWriter().getEncoder()), mBegin (begin),
+      mEnd (end), mError (error), mDone (done)
+    {}
+
+    template<class CollectionT>
+    void WriteCollectionStage<CollectionT>::WriteTask::run()
+    {
+        try
+        {
+            ESM::ESMWriter writer;
+            writer.setEncoder (&mEncoder);
+
+            // Batches start at a multiple of sBatchSize
+            for (int i=mBegin; i<mEnd; ++i)
+            {
+                mStage.writeRecord (writer, i);
+                writer.takeRecords (mStage.mBuffers[i % sBatchSize]);
+            }
+        }
+        catch (const std::exception& e)
+        {
+            mError = e.what();
+        }
+
+        mDone.release();
+    }
+
     template<class CollectionT>
     WriteCollectionStage<CollectionT>::WriteCollectionStage (const CollectionT& collection,
         SavingState& state)
@@ -86,15 +158,41 @@ namespace CSMDoc
     {}
 
     template<class CollectionT>
-    int WriteCollectionStage<CollectionT>::setup()
+    void WriteCollectionStage<CollectionT>::serialise (int begin, int end)
     {
-        return mCollection.getSize();
+        mBuffers.assign (end-begin, std::string());
+
+        int threads = std::max (1, std::min (QThread::idealThreadCount(), end-begin));
+        int size = (end-begin+threads-1) / threads;
+
+        std::vector<std::string> errors (threads);
+
+        // The global pool may run other tasks too, so wait for these ones only
+        QSemaphore done;
+        int tasks = 0;
+
+        for (int i=0; i<threads; ++i)
+        {
+            int first = begin + i*size;
+            if (first<end)
+            {
+                QThreadPool::globalInstance()->start (
+                    new WriteTask (*this, first, std::min (first+size, end), errors[i], done));
+                ++tasks;
+            }
+        }
+
+        done.acquire (tasks);
+
+        for (std::vector<std::string>::const_iterator iter (errors.begin()); iter!=errors.end(); ++iter)
+            if (!iter->empty())
+                throw std::runtime_error (*iter);
     }
 
     template<class CollectionT>
-    void WriteCollectionStage<CollectionT>::perform (int stage, std::vector<std::string>& messages)
+    void WriteCollectionStage<CollectionT>::writeRecord (ESM::ESMWriter& writer, int index) const
     {
-        CSMWorld::RecordBase::State state = mCollection.getRecord (stage).mState;
+        CSMWorld::RecordBase::State state = mCollection.getRecord (index).mState;
 
         if (state==CSMWorld::RecordBase::State_Modified ||
             state==CSMWorld::RecordBase::State_ModifiedOnly)
@@ -102,12 +200,12 @@ namespace CSMDoc
             std::string type;
             for (int i=0; i<4; ++i)
                 /// \todo make endianess agnostic (change ESMWriter interface?)
-                type += reinterpret_cast<const char *> (&mCollection.getRecord (stage).mModified.sRecordId)[i];
+                type += reinterpret_cast<const char *> (&mCollection.getRecord (index).mModified.sRecordId)[i];
 
-            mState.getWriter().startRecord (type);
-            mState.getWriter().writeHNCString ("NAME", mCollection.getId (stage));
-            mCollection.getRecord (stage).mModified.save (mState.getWriter());
-            mState.getWriter().endRecord (type);
+            writer.startRecord (type);
+            writer.writeHNCString ("NAME", mCollection.getId (index));
+            mCollection.getRecord (index).mModified.save (writer);
+            writer.endRecord (type);
         }
         else if (state==CSMWorld::RecordBase::State_Deleted)
         {
@@ -115,6 +213,22 @@ namespace CSMDoc
         }
     }
 
+    template<class CollectionT>
+    int WriteCollectionStage<CollectionT>::setup()
+    {
+        return mCollection.getSize();
+    }
+
+    template<class CollectionT>
+    void WriteCollectionStage<CollectionT>::perform (int stage, std::vector<std::string>& messages)
+    {
+        // Serialise a whole batch in parallel, then write one record per step
+        if (stage % sBatchSize==0)
+            serialise (stage, std::min (stage+sBatchSize, mCollection.getSize()));
+
+        mState.getWriter().writeRecords (mBuffers[stage % sBatchSize]);
+    }
+
 
     class WriteDialogueCollectionStage : public Stage
     {
@@ -157,12 +271,14 @@ namespace CSMDoc
             Document& mDocument;
             CSMFilter::Filter::Scope mScope;
 
+        protected:
+
+            virtual void writeRecord (ESM::ESMWriter& writer, int index) const;
+            ///< Only writes filters of the scope given to the constructor.
+
         public:
 
             WriteFilterStage (Document& document, SavingState& state, CSMFilter::Filter::Scope scope);
-
-            virtual void perform (int stage, std::vector<std::string>& messages);
-            ///< Messages resulting from this stage will be appended to \a messages.
     };
 
 
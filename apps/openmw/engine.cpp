@@ -17,6 +17,7 @@
 
 #include <components/nifbullet/bulletnifloader.hpp>
 #include <components/nifogre/ogrenifloader.hpp>
+#include <components/nifogre/mesh.hpp>
 
 #include <components/esm/loadcell.hpp>
 
@@ -177,36 +178,24 @@ OMW::Engine::~Engine()
 
 void OMW::Engine::loadBSA()
 {
-    // We use separate resource groups to handle location priority.
+    // All data directories and archives go into one index; see Bsa::VFS for
+    // how location priority is resolved.
     const Files::PathContainer& dataDirs = mFileCollections.getPaths();
 
-    int i=0;
     for (Files::PathContainer::const_iterator iter = dataDirs.begin(); iter != dataDirs.end(); ++iter)
     {
-        // Last data dir has the highest priority
-        std::string groupName = "Data" + Ogre::StringConverter::toString(dataDirs.size()-i, 8, '0');
-        Ogre::ResourceGroupManager::getSingleton ().createResourceGroup (groupName);
-
         std::string dataDirectory = iter->string();
         std::cout << "Data dir " << dataDirectory << std::endl;
-        Bsa::addDir(dataDirectory, mFSStrict, groupName);
-        ++i;
+        mVFS.addDir(dataDirectory, mFSStrict);
     }
 
-    i=0;
     for (std::vector<std::string>::const_iterator archive = mArchives.begin(); archive != mArchives.end(); ++archive)
     {
         if (mFileCollections.doesExist(*archive))
         {
-            // Last BSA has the highest priority
-            std::string groupName = "DataBSA" + Ogre::StringConverter::toString(mArchives.size()-i, 8, '0');
-
-            Ogre::ResourceGroupManager::getSingleton ().createResourceGroup (groupName);
-
             const std::string archivePath = mFileCollections.getPath(*archive).string();
             std::cout << "Adding BSA archive " << archivePath << std::endl;
-            Bsa::addBSA(archivePath, groupName);
-            ++i;
+            mVFS.addBSA(archivePath);
         }
         else
         {
@@ -215,6 +204,12 @@ void OMW::Engine::loadBSA()
             throw std::runtime_error(message.str());
         }
     }
+
+    Ogre::ResourceGroupManager::getSingleton ().createResourceGroup ("Data");
+    Bsa::addVFS(mVFS, "Data");
+
+    mVFS.startPrefetching(Settings::Manager::getInt("prefetch threads", "Content"),
+        Settings::Manager::getInt("prefetch cache size", "Content") * 1024 * 1024);
 }
 
 // add resources directory
@@ -370,6 +365,24 @@ void OMW::Engine::prepareEngine (Settings::Manager & settings)
 
     loadBSA();
 
+    NifOgre::Loader::setCompressKeyframes(settings.getBool("compress animations", "Objects"));
+
+    NifOgre::NIFMeshLoader::setLodLevels(settings.getInt("mesh lod levels", "Viewing distance"),
+                                         settings.getFloat("mesh lod distance", "Viewing distance"));
+
+    if (settings.getBool("mesh cache", "Content"))
+    {
+        boost::filesystem::path meshCache = mCfgMgr.getCachePath() / "meshes";
+        boost::filesystem::create_directories(meshCache);
+        NifOgre::NIFMeshLoader::setCachePath(meshCache.string());
+    }
+
+    if (settings.getBool("shape cache", "Content"))
+    {
+        boost::filesystem::path shapeCache = mCfgMgr.getCachePath() / "shapes";
+        boost::filesystem::create_directories(shapeCache);
+        NifBullet::ManualBulletShapeLoader::setCachePath(shapeCache.string());
+    }
 
     // Create input and UI first to set up a bootstrapping environment for
     // showing a loading screen and keeping the window responsive while doing so
@@ -385,7 +398,7 @@ void OMW::Engine::prepareEngine (Settings::Manager & settings)
     mEnvironment.setWindowManager (window);
 
     // Create the world
-    mEnvironment.setWorld( new MWWorld::World (*mOgre, mFileCollections, mContentFiles,
+    mEnvironment.setWorld( new MWWorld::World (*mOgre, mFileCollections, mVFS, mContentFiles,
         mResDir, mCfgMgr.getCachePath(), mEncoder, mFallbackMap,
         mActivationDistanceOverride));
     MWBase::Environment::get().getWorld()->setupPlayer();
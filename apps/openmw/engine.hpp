@@ -7,6 +7,7 @@
 #include <components/files/collections.hpp>
 #include <components/translation/translation.hpp>
 #include <components/settings/settings.hpp>
+#include <components/bsa/vfs.hpp>
 
 #include "mwbase/environment.hpp"
 
@@ -87,6 +88,7 @@ namespace OMW
 
             Files::Collections mFileCollections;
             bool mFSStrict;
+            Bsa::VFS mVFS;
             Translation::Storage mTranslationDataStorage;
 
             // not implemented
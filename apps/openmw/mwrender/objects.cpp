@@ -10,6 +10,9 @@
 #include <OgreParticleSystem.h>
 #include <OgreParticleEmitter.h>
 #include <OgreStaticGeometry.h>
+#include <OgreVertexIndexData.h>
+#include <OgreHardwareVertexBuffer.h>
+#include <OgreHardwareIndexBuffer.h>
 
 #include <components/nifogre/ogrenifloader.hpp>
 #include <components/settings/settings.hpp>
@@ -22,6 +25,47 @@
 
 using namespace MWRender;
 
+namespace
+{
+    // Rough size of an object's scene node and entities, without the shared meshes
+    const size_t sObjectSize = 2048;
+
+    size_t getGeometrySize(Ogre::StaticGeometry* sg)
+    {
+        size_t size = 0;
+
+        Ogre::StaticGeometry::RegionIterator regions = sg->getRegionIterator();
+        while(regions.hasMoreElements())
+        {
+            Ogre::StaticGeometry::Region::LODIterator lods = regions.getNext()->getLODIterator();
+            while(lods.hasMoreElements())
+            {
+                Ogre::StaticGeometry::LODBucket::MaterialIterator materials = lods.getNext()->getMaterialIterator();
+                while(materials.hasMoreElements())
+                {
+                    Ogre::StaticGeometry::MaterialBucket::GeometryIterator buckets = materials.getNext()->getGeometryIterator();
+                    while(buckets.hasMoreElements())
+                    {
+                        Ogre::StaticGeometry::GeometryBucket* bucket = buckets.getNext();
+
+                        const Ogre::VertexBufferBinding::VertexBufferBindingMap& bindings =
+                            bucket->getVertexData()->vertexBufferBinding->getBindings();
+                        for(Ogre::VertexBufferBinding::VertexBufferBindingMap::const_iterator it = bindings.begin();
+                            it != bindings.end(); ++it)
+                            size += it->second->getSizeInBytes();
+
+                        const Ogre::IndexData* indices = bucket->getIndexData();
+                        if(!indices->indexBuffer.isNull())
+                            size += indices->indexBuffer->getSizeInBytes();
+                    }
+                }
+            }
+        }
+
+        return size;
+    }
+}
+
 int Objects::uniqueID = 0;
 
 void Objects::setRootNode(Ogre::SceneNode* root)
@@ -95,6 +139,7 @@ void Objects::insertModel(const MWWorld::Ptr &ptr, const std::string &mesh)
 
     if(ptr.getTypeName() == typeid(ESM::Static).name() &&
        Settings::Manager::getBool("use static geometry", "Objects") &&
+       mBuiltCells.find(ptr.getCell()) == mBuiltCells.end() &&
        anim->canBatch())
     {
         Ogre::StaticGeometry* sg = 0;
@@ -202,6 +247,8 @@ void Objects::removeCell(MWWorld::Ptr::CellStore* store)
     }
 
     mBounds.erase(store);
+    mBuiltCells.erase(store);
+    mDetachedCells.erase(store);
 
     std::map<MWWorld::CellStore*,Ogre::SceneNode*>::iterator cell = mCellSceneNodes.find(store);
     if(cell != mCellSceneNodes.end())
@@ -212,8 +259,68 @@ void Objects::removeCell(MWWorld::Ptr::CellStore* store)
     }
 }
 
-void Objects::buildStaticGeometry(MWWorld::Ptr::CellStore& cell)
+void Objects::detachCell(MWWorld::Ptr::CellStore* store)
 {
+    mDetachedCells.insert(store);
+
+    std::map<MWWorld::CellStore*,Ogre::SceneNode*>::iterator cell = mCellSceneNodes.find(store);
+    if(cell != mCellSceneNodes.end() && cell->second->getParent())
+        mRootNode->removeChild(cell->second);
+
+    std::map<MWWorld::CellStore*,Ogre::StaticGeometry*>::iterator geom = mStaticGeometry.find(store);
+    if(geom != mStaticGeometry.end())
+        geom->second->setVisible(false);
+
+    geom = mStaticGeometrySmall.find(store);
+    if(geom != mStaticGeometrySmall.end())
+        geom->second->setVisible(false);
+}
+
+void Objects::attachCell(MWWorld::Ptr::CellStore* store)
+{
+    mDetachedCells.erase(store);
+
+    std::map<MWWorld::CellStore*,Ogre::SceneNode*>::iterator cell = mCellSceneNodes.find(store);
+    if(cell != mCellSceneNodes.end() && !cell->second->getParent())
+        mRootNode->addChild(cell->second);
+
+    std::map<MWWorld::CellStore*,Ogre::StaticGeometry*>::iterator geom = mStaticGeometry.find(store);
+    if(geom != mStaticGeometry.end())
+        geom->second->setVisible(true);
+
+    geom = mStaticGeometrySmall.find(store);
+    if(geom != mStaticGeometrySmall.end())
+        geom->second->setVisible(true);
+}
+
+size_t Objects::estimateMemoryUsage(MWWorld::Ptr::CellStore* store)
+{
+    size_t size = 0;
+
+    std::map<MWWorld::CellStore*,Ogre::SceneNode*>::iterator cell = mCellSceneNodes.find(store);
+    if(cell != mCellSceneNodes.end())
+        size += cell->second->numChildren() * sObjectSize;
+
+    // The batches hold copies of the geometry of all their statics
+    std::map<MWWorld::CellStore*,Ogre::StaticGeometry*>::iterator geom = mStaticGeometry.find(store);
+    if(geom != mStaticGeometry.end())
+        size += getGeometrySize(geom->second);
+
+    geom = mStaticGeometrySmall.find(store);
+    if(geom != mStaticGeometrySmall.end())
+        size += getGeometrySize(geom->second);
+
+    return size;
+}
+
+void Objects::buildStaticGeometry(MWWorld::Ptr::CellStore& cell, bool complete)
+{
+    // Statics are batched once all of them are in, so the geometry is built only once
+    if (!complete)
+        return;
+
+    mBuiltCells.insert(&cell);
+
     if(mStaticGeometry.find(&cell) != mStaticGeometry.end())
     {
         Ogre::StaticGeometry* sg = mStaticGeometry[&cell];
@@ -249,11 +356,19 @@ void Objects::update(float dt, Ogre::Camera* camera)
 {
     PtrAnimationMap::const_iterator it = mObjects.begin();
     for(;it != mObjects.end();it++)
+    {
+        if(!mDetachedCells.empty() && mDetachedCells.find(it->first.getCell()) != mDetachedCells.end())
+            continue;
         it->second->runAnimation(dt);
+    }
 
     it = mObjects.begin();
     for(;it != mObjects.end();it++)
+    {
+        if(!mDetachedCells.empty() && mDetachedCells.find(it->first.getCell()) != mDetachedCells.end())
+            continue;
         it->second->preRender(camera);
+    }
 
 }
 
@@ -263,12 +378,14 @@ void Objects::rebuildStaticGeometry()
     {
         it->second->destroy();
         it->second->build();
+        it->second->setVisible(mDetachedCells.find(it->first) == mDetachedCells.end());
     }
 
     for (std::map<MWWorld::CellStore *, Ogre::StaticGeometry*>::iterator it = mStaticGeometrySmall.begin(); it != mStaticGeometrySmall.end(); ++it)
     {
         it->second->destroy();
         it->second->build();
+        it->second->setVisible(mDetachedCells.find(it->first) == mDetachedCells.end());
     }
 }
 
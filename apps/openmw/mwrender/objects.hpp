@@ -1,6 +1,8 @@
 #ifndef GAME_RENDER_OBJECTS_H
 #define GAME_RENDER_OBJECTS_H
 
+#include <set>
+
 #include <OgreColourValue.h>
 #include <OgreAxisAlignedBox.h>
 
@@ -25,6 +27,10 @@ class Objects{
     std::map<MWWorld::CellStore*,Ogre::StaticGeometry*> mStaticGeometry;
     std::map<MWWorld::CellStore*,Ogre::StaticGeometry*> mStaticGeometrySmall;
     std::map<MWWorld::CellStore*,Ogre::AxisAlignedBox> mBounds;
+    // Cells whose static geometry is built; objects added later are not batched
+    std::set<MWWorld::CellStore*> mBuiltCells;
+    // Cells kept out of the scene by detachCell
+    std::set<MWWorld::CellStore*> mDetachedCells;
     PtrAnimationMap mObjects;
 
     Ogre::SceneNode* mRootNode;
@@ -58,7 +64,18 @@ public:
     ///< \return found?
 
     void removeCell(MWWorld::CellStore* store);
-    void buildStaticGeometry(MWWorld::CellStore &cell);
+
+    void detachCell(MWWorld::CellStore* store);
+    ///< Take the objects of a cell out of the scene, but keep them for attachCell.
+
+    void attachCell(MWWorld::CellStore* store);
+
+    size_t estimateMemoryUsage(MWWorld::CellStore* store);
+    ///< \return Approximate bytes used by the objects of the cell, beyond the shared meshes
+
+    void buildStaticGeometry(MWWorld::CellStore &cell, bool complete = true);
+    ///< \param complete Statics inserted afterwards are not batched anymore. Pass false while
+    /// more of them are on the way, which defers the build until they are in.
     void setRootNode(Ogre::SceneNode* root);
 
     void rebuildStaticGeometry();
@@ -224,6 +224,25 @@ void RenderingManager::removeCell (MWWorld::Ptr::CellStore *store)
     mDebugging->cellRemoved(store);
 }
 
+void RenderingManager::detachCell (MWWorld::Ptr::CellStore *store)
+{
+    mObjects->detachCell(store);
+    mActors->removeCell(store);
+    mDebugging->cellRemoved(store);
+}
+
+void RenderingManager::attachCell (MWWorld::Ptr::CellStore *store)
+{
+    mObjects->attachCell(store);
+    mDebugging->cellAdded(store);
+    waterAdded(store);
+}
+
+size_t RenderingManager::estimateMemoryUsage (MWWorld::Ptr::CellStore *store)
+{
+    return mObjects->estimateMemoryUsage(store);
+}
+
 void RenderingManager::removeWater ()
 {
     mWater->setActive(false);
@@ -234,14 +253,19 @@ void RenderingManager::toggleWater()
     mWater->toggle();
 }
 
-void RenderingManager::cellAdded (MWWorld::Ptr::CellStore *store)
+void RenderingManager::cellAdded (MWWorld::Ptr::CellStore *store, bool complete)
 {
-    mObjects->buildStaticGeometry (*store);
+    mObjects->buildStaticGeometry (*store, complete);
     sh::Factory::getInstance().unloadUnreferencedMaterials();
     mDebugging->cellAdded(store);
     waterAdded(store);
 }
 
+void RenderingManager::cellCompleted (MWWorld::Ptr::CellStore *store)
+{
+    mObjects->buildStaticGeometry (*store);
+}
+
 void RenderingManager::addObject (const MWWorld::Ptr& ptr){
     const MWWorld::Class& class_ =
             MWWorld::Class::get (ptr);
@@ -101,9 +101,23 @@ public:
 
     void removeCell (MWWorld::CellStore *store);
 
+    void detachCell (MWWorld::CellStore *store);
+    ///< Take a cell out of the scene, but keep its objects for attachCell. Actors are removed.
+
+    void attachCell (MWWorld::CellStore *store);
+
+    size_t estimateMemoryUsage (MWWorld::CellStore *store);
+    ///< \return Approximate bytes used by the objects of a cell
+
     /// \todo this function should be removed later. Instead the rendering subsystems should track
     /// when rebatching is needed and update automatically at the end of each frame.
-    void cellAdded (MWWorld::CellStore *store);
+    void cellAdded (MWWorld::CellStore *store, bool complete = true);
+    ///< \param complete False if objects of the cell are still to be inserted; call
+    /// cellCompleted once they are in.
+
+    void cellCompleted (MWWorld::CellStore *store);
+    ///< Batch the statics of a cell added as incomplete.
+
     void waterAdded(MWWorld::CellStore *store);
 
     void enableTerrain(bool enable);
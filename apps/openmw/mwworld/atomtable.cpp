@@ -0,0 +1,28 @@
+#include "atomtable.hpp"
+
+#include <components/misc/stringops.hpp>
+
+namespace MWWorld
+{
+    Atom AtomTable::intern(const std::string &id)
+    {
+        Atom atom = search(id);
+        if (atom != 0) {
+            return atom;
+        }
+
+        Entry entry;
+        entry.mId = Misc::StringUtils::lowerCase(id);
+        entry.mAtom = static_cast<Atom>(mEntries.size() + 1);
+        mEntries.push_back(entry);
+
+        mIndex.insert(mEntries.back().mId, &mEntries.back());
+        return entry.mAtom;
+    }
+
+    void AtomTable::clear()
+    {
+        mIndex.clear();
+        mEntries.clear();
+    }
+}
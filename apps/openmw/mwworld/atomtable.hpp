@@ -0,0 +1,56 @@
+#ifndef OPENMW_MWWORLD_ATOMTABLE_H
+#define OPENMW_MWWORLD_ATOMTABLE_H
+
+#include <string>
+#include <deque>
+
+#include "recordindex.hpp"
+
+namespace MWWorld
+{
+    /// Interned record ID. IDs that only differ in case share the same atom.
+    typedef unsigned int Atom;
+
+    /// \brief Table of interned record IDs
+    ///
+    /// Atoms are numbered from 1 in the order the IDs were added; 0 stands
+    /// for an ID that is not in the table. Comparing or hashing atoms is
+    /// much cheaper than doing the same with the IDs, so hot paths should
+    /// look an ID up once and pass the atom around.
+    class AtomTable
+    {
+        struct Entry
+        {
+            std::string mId; // lower case
+            Atom mAtom;
+        };
+
+        // deque keeps the keys in place for mIndex
+        std::deque<Entry> mEntries;
+        RecordIndex<Entry> mIndex;
+
+    public:
+        /// Return the atom of \a id, adding it to the table if needed.
+        Atom intern(const std::string &id);
+
+        /// Return the atom of \a id or 0 if it is not in the table. Does not allocate.
+        Atom search(const std::string &id) const {
+            const Entry *entry = mIndex.search(id);
+            return entry != 0 ? entry->mAtom : 0;
+        }
+
+        /// Lower case ID of \a atom.
+        const std::string &getId(Atom atom) const {
+            return mEntries.at(atom - 1).mId;
+        }
+
+        /// Highest atom in use.
+        size_t size() const {
+            return mEntries.size();
+        }
+
+        void clear();
+    };
+}
+
+#endif
@@ -0,0 +1,40 @@
+#include "cellfunctors.hpp"
+
+#include <components/bsa/vfs.hpp>
+
+#include "esmstore.hpp"
+
+template<typename T>
+void MWWorld::PrefetchModels::prefetch (Atom id, const ESMStore& store)
+{
+    const T *record = store.get<T>().search (id);
+
+    // Same path as the classes' getModel()
+    if (record && !record->mModel.empty())
+        mVFS.prefetch ("meshes\\" + record->mModel);
+}
+
+void MWWorld::PrefetchModels::operator() (Atom id, const ESMStore& store)
+{
+    // NPCs and levelled lists are left out; their models depend on more than the record.
+    switch (store.find (id))
+    {
+        case ESM::REC_ACTI: prefetch<ESM::Activator> (id, store); break;
+        case ESM::REC_ALCH: prefetch<ESM::Potion> (id, store); break;
+        case ESM::REC_APPA: prefetch<ESM::Apparatus> (id, store); break;
+        case ESM::REC_ARMO: prefetch<ESM::Armor> (id, store); break;
+        case ESM::REC_BOOK: prefetch<ESM::Book> (id, store); break;
+        case ESM::REC_CLOT: prefetch<ESM::Clothing> (id, store); break;
+        case ESM::REC_CONT: prefetch<ESM::Container> (id, store); break;
+        case ESM::REC_CREA: prefetch<ESM::Creature> (id, store); break;
+        case ESM::REC_DOOR: prefetch<ESM::Door> (id, store); break;
+        case ESM::REC_INGR: prefetch<ESM::Ingredient> (id, store); break;
+        case ESM::REC_LIGH: prefetch<ESM::Light> (id, store); break;
+        case ESM::REC_LOCK: prefetch<ESM::Lockpick> (id, store); break;
+        case ESM::REC_MISC: prefetch<ESM::Miscellaneous> (id, store); break;
+        case ESM::REC_PROB: prefetch<ESM::Probe> (id, store); break;
+        case ESM::REC_REPA: prefetch<ESM::Repair> (id, store); break;
+        case ESM::REC_STAT: prefetch<ESM::Static> (id, store); break;
+        case ESM::REC_WEAP: prefetch<ESM::Weapon> (id, store); break;
+    }
+}
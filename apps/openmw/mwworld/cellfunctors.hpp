@@ -5,14 +5,22 @@
 #include <string>
 
 #include "ptr.hpp"
+#include "atomtable.hpp"
 
 namespace ESM
 {
     class CellRef;
 }
 
+namespace Bsa
+{
+    class VFS;
+}
+
 namespace MWWorld
 {
+    class ESMStore;
+
     /// List all (Ogre-)handles, then reset RefData::mBaseNode to 0.
     struct ListAndResetHandles
     {
@@ -28,6 +36,36 @@ namespace MWWorld
             return true;
         }
     };
+
+    /// List all references that are in the scene.
+    struct ListInsertedObjects
+    {
+        std::vector<MWWorld::Ptr> mObjects;
+
+        bool operator() (MWWorld::Ptr ptr)
+        {
+            if (ptr.getRefData().getBaseNode())
+                mObjects.push_back (ptr);
+            return true;
+        }
+    };
+
+    /// Prefetch the models of references, as listed by CellStore::listRefs (no LiveCellRef
+    /// needed).
+    struct PrefetchModels
+    {
+        const Bsa::VFS& mVFS;
+
+        PrefetchModels (const Bsa::VFS& vfs) : mVFS (vfs) {}
+
+        /// Prefetch the model of the record \a id.
+        void operator() (Atom id, const ESMStore& store);
+
+        private:
+
+            template<typename T>
+            void prefetch (Atom id, const ESMStore& store);
+    };
 }
 
 #endif
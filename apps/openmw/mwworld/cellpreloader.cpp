@@ -0,0 +1,263 @@
+#include "cellpreloader.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+
+#include <boost/bind.hpp>
+
+#include <components/bsa/vfs.hpp>
+#include <components/misc/stringops.hpp>
+
+#include "../mwbase/environment.hpp"
+#include "../mwbase/world.hpp"
+
+#include "physicssystem.hpp"
+#include "cellstore.hpp"
+#include "class.hpp"
+
+namespace
+{
+    // Faster than this is a teleport, not movement
+    const float sMaxSpeed = 10000.0f;
+
+    // Seconds over which the velocity is smoothed
+    const float sSmoothingTime = 0.5f;
+
+    // Collision shapes built per frame, on the main thread
+    const int sShapesPerFrame = 4;
+
+    /// List the models of all enabled references, with the scale Scene::insertCell uses.
+    struct CollectModels
+    {
+        std::vector<std::pair<std::string, float> > mModels;
+
+        bool operator() (MWWorld::Ptr ptr)
+        {
+            if (!ptr.getRefData().isEnabled())
+                return true;
+
+            std::string model = MWWorld::Class::get (ptr).getModel (ptr);
+
+            if (!model.empty())
+            {
+                float scale = std::min (std::max (ptr.getCellRef().mScale, 0.5f), 2.0f);
+                mModels.push_back (std::make_pair (model, scale));
+            }
+
+            return true;
+        }
+    };
+}
+
+namespace MWWorld
+{
+    CellPreloader::CellPreloader (const Bsa::VFS& vfs, PhysicsSystem& physics,
+        unsigned int threads, float lookahead, int radius)
+    : mVFS (vfs), mPhysics (physics), mLookahead (lookahead), mRadius (radius),
+      mLastPosition (Ogre::Vector3::ZERO), mVelocity (Ogre::Vector3::ZERO), mHasPosition (false),
+      mHasTarget (false), mGeneration (0), mBusy (0), mQuit (false)
+    {
+        for (unsigned int i=0; i<threads; ++i)
+            mThreads.create_thread (boost::bind (&CellPreloader::run, this));
+    }
+
+    CellPreloader::~CellPreloader()
+    {
+        {
+            boost::unique_lock<boost::mutex> lock (mMutex);
+            mQuit = true;
+        }
+        mCondition.notify_all();
+
+        mThreads.join_all();
+    }
+
+    void CellPreloader::update (float duration, const Ogre::Vector3& playerPos, int cellX, int cellY)
+    {
+        if (mHasPosition && duration>0)
+        {
+            Ogre::Vector3 velocity = (playerPos - mLastPosition) / duration;
+
+            if (velocity.squaredLength() > sMaxSpeed*sMaxSpeed)
+                velocity = Ogre::Vector3::ZERO;
+
+            float blend = std::min (duration / sSmoothingTime, 1.0f);
+            mVelocity += (velocity - mVelocity) * blend;
+        }
+
+        mLastPosition = playerPos;
+        mHasPosition = true;
+
+        Ogre::Vector3 predicted = playerPos + mVelocity * mLookahead;
+
+        int x = 0;
+        int y = 0;
+        MWBase::Environment::get().getWorld()->positionToIndex (predicted.x, predicted.y, x, y);
+
+        int dx = std::max (-1, std::min (x-cellX, 1));
+        int dy = std::max (-1, std::min (y-cellY, 1));
+
+        // Keep the last target when the player stops, instead of throwing the work away
+        if (dx!=0 || dy!=0)
+        {
+            CellIndex target (cellX+dx, cellY+dy);
+
+            if (!mHasTarget || target!=mTarget)
+                retarget (cellX, cellY, target);
+        }
+
+        if (!mCellsToLoad.empty())
+        {
+            CellIndex index = mCellsToLoad.front();
+            mCellsToLoad.pop_front();
+
+            loadCell (index);
+        }
+        else if (!mShapes.empty() && !isParsing())
+        {
+            // Only once the files are parsed, or building the shapes would parse them here
+            for (int i=0; i<sShapesPerFrame && !mShapes.empty(); ++i)
+            {
+                Shape shape = mShapes.front();
+                mShapes.pop_front();
+
+                try
+                {
+                    mPhysics.prepareObject (shape.first, shape.second);
+                }
+                catch (const std::exception&)
+                {
+                    // Reported when the object is inserted
+                }
+            }
+        }
+    }
+
+    void CellPreloader::clear()
+    {
+        std::vector<Nif::NIFFile::ptr> files;
+
+        {
+            boost::unique_lock<boost::mutex> lock (mMutex);
+
+            // Files still being parsed are dropped by the workers
+            ++mGeneration;
+            mJobs.clear();
+            mFiles.swap (files);
+        }
+
+        mCellsToLoad.clear();
+        mShapes.clear();
+        mQueuedFiles.clear();
+        mQueuedShapes.clear();
+        mHasTarget = false;
+    }
+
+    void CellPreloader::retarget (int cellX, int cellY, const CellIndex& target)
+    {
+        clear();
+
+        mTarget = target;
+        mHasTarget = true;
+
+        // The cells of the grid around the target that are not active yet
+        for (int x=target.first-mRadius; x<=target.first+mRadius; ++x)
+            for (int y=target.second-mRadius; y<=target.second+mRadius; ++y)
+                if (std::abs (x-cellX)>mRadius || std::abs (y-cellY)>mRadius)
+                    mCellsToLoad.push_back (CellIndex (x, y));
+    }
+
+    void CellPreloader::loadCell (const CellIndex& index)
+    {
+        CellStore *cell = MWBase::Environment::get().getWorld()->getExterior (index.first, index.second);
+
+        CollectModels functor;
+        cell->forEach (functor);
+
+        std::vector<std::string> names;
+
+        for (std::vector<Shape>::const_iterator iter (functor.mModels.begin());
+            iter!=functor.mModels.end(); ++iter)
+        {
+            // NIFFile::create shares files regardless of case
+            std::string lower = Misc::StringUtils::lowerCase (iter->first);
+
+            if (mQueuedFiles.insert (lower).second)
+                names.push_back (lower);
+
+            if (mQueuedShapes.insert (*iter).second)
+                mShapes.push_back (*iter);
+        }
+
+        if (names.empty())
+            return;
+
+        {
+            boost::unique_lock<boost::mutex> lock (mMutex);
+
+            for (std::vector<std::string>::const_iterator iter (names.begin()); iter!=names.end(); ++iter)
+            {
+                Job job;
+                job.mGeneration = mGeneration;
+                job.mName = *iter;
+                mJobs.push_back (job);
+            }
+        }
+        mCondition.notify_all();
+    }
+
+    bool CellPreloader::isParsing()
+    {
+        boost::unique_lock<boost::mutex> lock (mMutex);
+
+        return !mJobs.empty() || mBusy>0;
+    }
+
+    void CellPreloader::run()
+    {
+        while (true)
+        {
+            Job job;
+
+            {
+                boost::unique_lock<boost::mutex> lock (mMutex);
+
+                while (mJobs.empty() && !mQuit)
+                    mCondition.wait (lock);
+
+                if (mQuit)
+                    return;
+
+                job = mJobs.front();
+                mJobs.pop_front();
+                ++mBusy;
+            }
+
+            Nif::NIFFile::ptr file;
+
+            try
+            {
+                // Through the VFS, as Ogre's resource system is not thread safe
+                file = Nif::NIFFile::create (job.mName, mVFS.open (job.mName));
+            }
+            catch (const std::exception&)
+            {
+                // Reported when the object is inserted
+            }
+
+            {
+                boost::unique_lock<boost::mutex> lock (mMutex);
+
+                --mBusy;
+
+                if (file && job.mGeneration==mGeneration)
+                {
+                    mFiles.push_back (file);
+                    file.reset();
+                }
+            }
+
+            // A file of a dropped target is released here, outside of the lock
+        }
+    }
+}
@@ -0,0 +1,107 @@
+#ifndef GAME_MWWORLD_CELLPRELOADER_H
+#define GAME_MWWORLD_CELLPRELOADER_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <set>
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include <OgreVector3.h>
+
+#include <components/nif/niffile.hpp>
+
+namespace Bsa
+{
+    class VFS;
+}
+
+namespace MWWorld
+{
+    class PhysicsSystem;
+
+    /// \brief Prepares the exterior cells the player is heading for
+    ///
+    /// The position of the player a few seconds ahead is predicted from its
+    /// velocity. When that is in another cell, the cells that become active on
+    /// crossing into it are prepared: their references are loaded on the main
+    /// thread, one cell per frame, the NIF files of their models are parsed by
+    /// worker threads, and their collision shapes are built a few per frame.
+    /// The parsed files are kept until the cells are inserted.
+    class CellPreloader
+    {
+        public:
+
+            CellPreloader (const Bsa::VFS& vfs, PhysicsSystem& physics,
+                unsigned int threads, float lookahead, int radius);
+            ///< \param lookahead Seconds to predict the player position ahead
+            /// \param radius Of the grid of active cells around the player
+
+            ~CellPreloader();
+
+            void update (float duration, const Ogre::Vector3& playerPos, int cellX, int cellY);
+            ///< Call every frame while the player is in the exterior cell \a cellX, \a cellY.
+
+            void clear();
+            ///< Drop all prepared files and forget the prediction, e.g. after a cell change.
+
+        private:
+
+            typedef std::pair<int, int> CellIndex;
+            typedef std::pair<std::string, float> Shape;
+
+            struct Job
+            {
+                unsigned int mGeneration;
+                std::string mName;
+            };
+
+            const Bsa::VFS& mVFS;
+            PhysicsSystem& mPhysics;
+            float mLookahead;
+            int mRadius;
+
+            Ogre::Vector3 mLastPosition;
+            Ogre::Vector3 mVelocity;
+            bool mHasPosition;
+
+            CellIndex mTarget;
+            bool mHasTarget;
+
+            // Only used by the main thread
+            std::deque<CellIndex> mCellsToLoad;
+            std::deque<Shape> mShapes;
+            std::set<std::string> mQueuedFiles;
+            std::set<Shape> mQueuedShapes;
+
+            // Shared with the workers, protected by mMutex
+            boost::mutex mMutex;
+            boost::condition_variable mCondition;
+            std::deque<Job> mJobs;
+            std::vector<Nif::NIFFile::ptr> mFiles;
+            unsigned int mGeneration;
+            unsigned int mBusy;
+            bool mQuit;
+
+            boost::thread_group mThreads;
+
+            void run();
+            ///< Worker thread: parse the queued files.
+
+            void retarget (int cellX, int cellY, const CellIndex& target);
+
+            void loadCell (const CellIndex& index);
+            ///< Load the references of a cell, and queue its files and shapes.
+
+            bool isParsing();
+
+            // not implemented
+            CellPreloader (const CellPreloader&);
+            CellPreloader& operator= (const CellPreloader&);
+    };
+}
+
+#endif
@@ -1,5 +1,7 @@
 #include "cells.hpp"
 
+#include <algorithm>
+
 #include "../mwbase/environment.hpp"
 #include "../mwbase/world.hpp"
 
@@ -7,6 +9,21 @@
 #include "esmstore.hpp"
 #include "containerstore.hpp"
 
+namespace
+{
+    // Find a reference to the record with the given atom. References keep their lower case
+    // ID, which is what the atom table holds too.
+    template<typename T>
+    MWWorld::LiveCellRef<T> *findRef (MWWorld::CellRefList<T>& list, const MWWorld::ESMStore& store,
+        MWWorld::Atom atom)
+    {
+        if (list.mList.empty())
+            return 0;
+
+        return list.find (store.getAtoms().getId (atom));
+    }
+}
+
 MWWorld::Ptr::CellStore *MWWorld::Cells::getCellStore (const ESM::Cell *cell)
 {
     if (cell->mData.mFlags & ESM::Cell::Interior)
@@ -41,31 +58,68 @@ void MWWorld::Cells::clear()
 {
     mInteriors.clear();
     mExteriors.clear();
-    std::fill(mIdCache.begin(), mIdCache.end(), std::make_pair("", (MWWorld::Ptr::CellStore*)0));
-    mIdCacheIndex = 0;
+    mIdCache.clear();
 }
 
-MWWorld::Ptr MWWorld::Cells::getPtrAndCache (const std::string& name, Ptr::CellStore& cellStore)
+MWWorld::Ptr MWWorld::Cells::getPtrAndCache (Atom atom, Ptr::CellStore& cellStore)
 {
-    Ptr ptr = getPtr (name, cellStore);
+    Ptr ptr = getPtr (atom, cellStore);
 
     if (!ptr.isEmpty() && ptr.isInCell())
-    {
-        mIdCache[mIdCacheIndex].first = name;
-        mIdCache[mIdCacheIndex].second = &cellStore;
-        if (++mIdCacheIndex>=mIdCache.size())
-            mIdCacheIndex = 0;
-    }
+        mIdCache[atom] = &cellStore;
 
     return ptr;
 }
 
 MWWorld::Cells::Cells (const MWWorld::ESMStore& store, std::vector<ESM::ESMReader>& reader)
-: mStore (store), mReader (reader),
-  mIdCache (40, std::pair<std::string, Ptr::CellStore *> ("", (Ptr::CellStore*)0)), /// \todo make cache size configurable
-  mIdCacheIndex (0)
+: mStore (store), mReader (reader)
 {}
 
+void MWWorld::Cells::indexRefs()
+{
+    std::vector<const ESM::Cell *> cells;
+
+    const MWWorld::Store<ESM::Cell> &store = mStore.get<ESM::Cell>();
+    MWWorld::Store<ESM::Cell>::iterator iter;
+
+    for (iter = store.extBegin(); iter != store.extEnd(); ++iter)
+        cells.push_back (&*iter);
+
+    for (iter = store.intBegin(); iter != store.intEnd(); ++iter)
+        cells.push_back (&*iter);
+
+    // (atom, index in cells) for each distinct ID in each cell
+    std::vector<std::pair<Atom, std::size_t> > refs;
+    std::vector<Atom> ids;
+
+    for (std::size_t i = 0; i < cells.size(); ++i)
+    {
+        ids.clear();
+        Ptr::CellStore::listRefs (cells[i], mStore, mReader, ids);
+
+        std::sort (ids.begin(), ids.end());
+        ids.erase (std::unique (ids.begin(), ids.end()), ids.end());
+
+        for (std::vector<Atom>::const_iterator id = ids.begin(); id != ids.end(); ++id)
+            refs.push_back (std::make_pair (*id, i));
+    }
+
+    // Exterior cells are still searched before interior cells
+    std::sort (refs.begin(), refs.end());
+
+    mRefCellOffsets.assign (mStore.getAtoms().size() + 2, 0);
+    mRefCells.resize (refs.size());
+
+    for (std::size_t i = 0; i < refs.size(); ++i)
+    {
+        ++mRefCellOffsets[refs[i].first + 1];
+        mRefCells[i] = cells[refs[i].second];
+    }
+
+    for (std::size_t i = 1; i < mRefCellOffsets.size(); ++i)
+        mRefCellOffsets[i] += mRefCellOffsets[i-1];
+}
+
 MWWorld::Ptr::CellStore *MWWorld::Cells::getExterior (int x, int y)
 {
     std::map<std::pair<int, int>, Ptr::CellStore>::iterator result =
@@ -124,13 +178,28 @@ MWWorld::Ptr::CellStore *MWWorld::Cells::getInterior (const std::string& name)
 
 MWWorld::Ptr MWWorld::Cells::getPtr (const std::string& name, Ptr::CellStore& cell,
     bool searchInContainers)
+{
+    Atom atom = mStore.getAtom (name);
+
+    if (atom==0)
+    {
+        // Not the ID of a record, but containers are searched by name
+        if (searchInContainers && cell.mState==Ptr::CellStore::State_Loaded)
+            return cell.searchInContainer (name);
+        return Ptr();
+    }
+
+    return getPtr (atom, cell, searchInContainers);
+}
+
+MWWorld::Ptr MWWorld::Cells::getPtr (Atom atom, Ptr::CellStore& cell, bool searchInContainers)
 {
     if (cell.mState==Ptr::CellStore::State_Unloaded)
         cell.preload (mStore, mReader);
 
     if (cell.mState==Ptr::CellStore::State_Preloaded)
     {
-        if (std::binary_search (cell.mIds.begin(), cell.mIds.end(), name))
+        if (std::binary_search (cell.mIds.begin(), cell.mIds.end(), atom))
         {
             cell.load (mStore, mReader);
         }
@@ -138,123 +207,131 @@ MWWorld::Ptr MWWorld::Cells::getPtr (const std::string& name, Ptr::CellStore& ce
             return Ptr();
     }
 
-    if (MWWorld::LiveCellRef<ESM::Activator> *ref = cell.mActivators.find (name))
+    if (MWWorld::LiveCellRef<ESM::Activator> *ref = findRef (cell.mActivators, mStore, atom))
         return Ptr (ref, &cell);
 
-    if (MWWorld::LiveCellRef<ESM::Potion> *ref = cell.mPotions.find (name))
+    if (MWWorld::LiveCellRef<ESM::Potion> *ref = findRef (cell.mPotions, mStore, atom))
         return Ptr (ref, &cell);
 
-    if (MWWorld::LiveCellRef<ESM::Apparatus> *ref = cell.mAppas.find (name))
+    if (MWWorld::LiveCellRef<ESM::Apparatus> *ref = findRef (cell.mAppas, mStore, atom))
         return Ptr (ref, &cell);
 
-    if (MWWorld::LiveCellRef<ESM::Armor> *ref = cell.mArmors.find (name))
+    if (MWWorld::LiveCellRef<ESM::Armor> *ref = findRef (cell.mArmors, mStore, atom))
         return Ptr (ref, &cell);
 
-    if (MWWorld::LiveCellRef<ESM::Book> *ref = cell.mBooks.find (name))
+    if (MWWorld::LiveCellRef<ESM::Book> *ref = findRef (cell.mBooks, mStore, atom))
         return Ptr (ref, &cell);
 
-    if (MWWorld::LiveCellRef<ESM::Clothing> *ref = cell.mClothes.find (name))
+    if (MWWorld::LiveCellRef<ESM::Clothing> *ref = findRef (cell.mClothes, mStore, atom))
         return Ptr (ref, &cell);
 
-    if (MWWorld::LiveCellRef<ESM::Container> *ref = cell.mContainers.find (name))
+    if (MWWorld::LiveCellRef<ESM::Container> *ref = findRef (cell.mContainers, mStore, atom))
         return Ptr (ref, &cell);
 
-    if (MWWorld::LiveCellRef<ESM::Creature> *ref = cell.mCreatures.find (name))
+    if (MWWorld::LiveCellRef<ESM::Creature> *ref = findRef (cell.mCreatures, mStore, atom))
         return Ptr (ref, &cell);
 
-    if (MWWorld::LiveCellRef<ESM::Door> *ref = cell.mDoors.find (name))
+    if (MWWorld::LiveCellRef<ESM::Door> *ref = findRef (cell.mDoors, mStore, atom))
         return Ptr (ref, &cell);
 
-    if (MWWorld::LiveCellRef<ESM::Ingredient> *ref = cell.mIngreds.find (name))
+    if (MWWorld::LiveCellRef<ESM::Ingredient> *ref = findRef (cell.mIngreds, mStore, atom))
         return Ptr (ref, &cell);
 
-    if (MWWorld::LiveCellRef<ESM::CreatureLevList> *ref = cell.mCreatureLists.find (name))
+    if (MWWorld::LiveCellRef<ESM::CreatureLevList> *ref = findRef (cell.mCreatureLists, mStore, atom))
         return Ptr (ref, &cell);
 
-    if (MWWorld::LiveCellRef<ESM::ItemLevList> *ref = cell.mItemLists.find (name))
+    if (MWWorld::LiveCellRef<ESM::ItemLevList> *ref = findRef (cell.mItemLists, mStore, atom))
         return Ptr (ref, &cell);
 
-    if (MWWorld::LiveCellRef<ESM::Light> *ref = cell.mLights.find (name))
+    if (MWWorld::LiveCellRef<ESM::Light> *ref = findRef (cell.mLights, mStore, atom))
         return Ptr (ref, &cell);
 
-    if (MWWorld::LiveCellRef<ESM::Lockpick> *ref = cell.mLockpicks.find (name))
+    if (MWWorld::LiveCellRef<ESM::Lockpick> *ref = findRef (cell.mLockpicks, mStore, atom))
         return Ptr (ref, &cell);
 
-    if (MWWorld::LiveCellRef<ESM::Miscellaneous> *ref = cell.mMiscItems.find (name))
+    if (MWWorld::LiveCellRef<ESM::Miscellaneous> *ref = findRef (cell.mMiscItems, mStore, atom))
         return Ptr (ref, &cell);
 
-    if (MWWorld::LiveCellRef<ESM::NPC> *ref = cell.mNpcs.find (name))
+    if (MWWorld::LiveCellRef<ESM::NPC> *ref = findRef (cell.mNpcs, mStore, atom))
         return Ptr (ref, &cell);
 
-    if (MWWorld::LiveCellRef<ESM::Probe> *ref = cell.mProbes.find (name))
+    if (MWWorld::LiveCellRef<ESM::Probe> *ref = findRef (cell.mProbes, mStore, atom))
         return Ptr (ref, &cell);
 
-    if (MWWorld::LiveCellRef<ESM::Repair> *ref = cell.mRepairs.find (name))
+    if (MWWorld::LiveCellRef<ESM::Repair> *ref = findRef (cell.mRepairs, mStore, atom))
         return Ptr (ref, &cell);
 
-    if (MWWorld::LiveCellRef<ESM::Static> *ref = cell.mStatics.find (name))
+    if (MWWorld::LiveCellRef<ESM::Static> *ref = findRef (cell.mStatics, mStore, atom))
         return Ptr (ref, &cell);
 
-    if (MWWorld::LiveCellRef<ESM::Weapon> *ref = cell.mWeapons.find (name))
+    if (MWWorld::LiveCellRef<ESM::Weapon> *ref = findRef (cell.mWeapons, mStore, atom))
         return Ptr (ref, &cell);
 
     if (searchInContainers)
-        return cell.searchInContainer (name);
+        return cell.searchInContainer (mStore.getAtoms().getId (atom));
 
     return Ptr();
 }
 
 MWWorld::Ptr MWWorld::Cells::getPtr (const std::string& name)
+{
+    Atom atom = mStore.getAtom (name);
+
+    if (atom==0)
+        return Ptr();
+
+    return getPtr (atom);
+}
+
+MWWorld::Ptr MWWorld::Cells::getPtr (Atom atom)
 {
     // First check the cache
-    for (std::vector<std::pair<std::string, Ptr::CellStore *> >::iterator iter (mIdCache.begin());
-        iter!=mIdCache.end(); ++iter)
-        if (iter->first==name && iter->second)
-        {
-            Ptr ptr = getPtr (name, *iter->second);
-            if (!ptr.isEmpty())
-                return ptr;
-        }
+    std::tr1::unordered_map<Atom, Ptr::CellStore *>::const_iterator cached = mIdCache.find (atom);
+    if (cached!=mIdCache.end())
+    {
+        Ptr ptr = getPtr (atom, *cached->second);
+        if (!ptr.isEmpty())
+            return ptr;
+    }
 
-    // Then check cells that are already listed
+    // Then check loaded cells, which may hold references that were added after indexRefs()
     for (std::map<std::pair<int, int>, Ptr::CellStore>::iterator iter = mExteriors.begin();
         iter!=mExteriors.end(); ++iter)
     {
-        Ptr ptr = getPtrAndCache (name, iter->second);
-        if (!ptr.isEmpty())
-            return ptr;
+        if (iter->second.mState==Ptr::CellStore::State_Loaded)
+        {
+            Ptr ptr = getPtrAndCache (atom, iter->second);
+            if (!ptr.isEmpty())
+                return ptr;
+        }
     }
 
     for (std::map<std::string, Ptr::CellStore>::iterator iter = mInteriors.begin();
         iter!=mInteriors.end(); ++iter)
     {
-        Ptr ptr = getPtrAndCache (name, iter->second);
-        if (!ptr.isEmpty())
-            return ptr;
+        if (iter->second.mState==Ptr::CellStore::State_Loaded)
+        {
+            Ptr ptr = getPtrAndCache (atom, iter->second);
+            if (!ptr.isEmpty())
+                return ptr;
+        }
     }
 
-    // Now try the other cells
-    const MWWorld::Store<ESM::Cell> &cells = mStore.get<ESM::Cell>();
-    MWWorld::Store<ESM::Cell>::iterator iter;
-
-    for (iter = cells.extBegin(); iter != cells.extEnd(); ++iter)
+    // Now try the other cells that reference the record
+    if (atom+1<mRefCellOffsets.size())
     {
-        Ptr::CellStore *cellStore = getCellStore (&(*iter));
-
-        Ptr ptr = getPtrAndCache (name, *cellStore);
-
-        if (!ptr.isEmpty())
-            return ptr;
-    }
+        for (std::size_t i = mRefCellOffsets[atom]; i<mRefCellOffsets[atom+1]; ++i)
+        {
+            Ptr::CellStore *cellStore = getCellStore (mRefCells[i]);
 
-    for (iter = cells.intBegin(); iter != cells.intEnd(); ++iter)
-    {
-        Ptr::CellStore *cellStore = getCellStore (&(*iter));
+            if (cellStore->mState==Ptr::CellStore::State_Loaded)
+                continue;
 
-        Ptr ptr = getPtrAndCache (name, *cellStore);
+            Ptr ptr = getPtrAndCache (atom, *cellStore);
 
-        if (!ptr.isEmpty())
-            return ptr;
+            if (!ptr.isEmpty())
+                return ptr;
+        }
     }
 
     // giving up
@@ -263,10 +340,14 @@ MWWorld::Ptr MWWorld::Cells::getPtr (const std::string& name)
 
 void MWWorld::Cells::getExteriorPtrs(const std::string &name, std::vector<MWWorld::Ptr> &out)
 {
+    Atom atom = mStore.getAtom (name);
+    if (atom==0)
+        return;
+
     for (std::map<std::pair<int, int>, Ptr::CellStore>::iterator iter = mExteriors.begin();
         iter!=mExteriors.end(); ++iter)
     {
-        Ptr ptr = getPtrAndCache (name, iter->second);
+        Ptr ptr = getPtrAndCache (atom, iter->second);
         if (!ptr.isEmpty())
             out.push_back(ptr);
     }
@@ -275,10 +356,14 @@ void MWWorld::Cells::getExteriorPtrs(const std::string &name, std::vector<MWWorl
 
 void MWWorld::Cells::getInteriorPtrs(const std::string &name, std::vector<MWWorld::Ptr> &out)
 {
+    Atom atom = mStore.getAtom (name);
+    if (atom==0)
+        return;
+
     for (std::map<std::string, Ptr::CellStore>::iterator iter = mInteriors.begin();
         iter!=mInteriors.end(); ++iter)
     {
-        Ptr ptr = getPtrAndCache (name, iter->second);
+        Ptr ptr = getPtrAndCache (atom, iter->second);
         if (!ptr.isEmpty())
             out.push_back(ptr);
     }
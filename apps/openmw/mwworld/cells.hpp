@@ -5,11 +5,21 @@
 #include <list>
 #include <string>
 
+#ifdef _WIN32
+#include <boost/tr1/tr1/unordered_map>
+#elif defined HAVE_UNORDERED_MAP
+#include <unordered_map>
+#else
+#include <tr1/unordered_map>
+#endif
+
 #include "ptr.hpp"
+#include "atomtable.hpp"
 
 namespace ESM
 {
     class ESMReader;
+    struct Cell;
 }
 
 namespace MWWorld
@@ -23,15 +33,19 @@ namespace MWWorld
             std::vector<ESM::ESMReader>& mReader;
             std::map<std::string, CellStore> mInteriors;
             std::map<std::pair<int, int>, CellStore> mExteriors;
-            std::vector<std::pair<std::string, CellStore *> > mIdCache;
-            std::size_t mIdCacheIndex;
+            std::tr1::unordered_map<Atom, CellStore *> mIdCache;
+
+            // Cells with references to each atom: the cells for atom a are
+            // mRefCells[mRefCellOffsets[a]] to mRefCells[mRefCellOffsets[a+1]-1]
+            std::vector<std::size_t> mRefCellOffsets;
+            std::vector<const ESM::Cell *> mRefCells;
 
             Cells (const Cells&);
             Cells& operator= (const Cells&);
 
             CellStore *getCellStore (const ESM::Cell *cell);
 
-            Ptr getPtrAndCache (const std::string& name, CellStore& cellStore);
+            Ptr getPtrAndCache (Atom atom, CellStore& cellStore);
 
         public:
 
@@ -41,6 +55,11 @@ namespace MWWorld
             ///< \todo pass the dynamic part of the ESMStore isntead (once it is written) of the whole
             /// world
 
+            /// Record which cells reference each record, so that getPtr (atom) does not
+            /// have to search the whole world. Reads the references of every cell.
+            /// \note Call once after the ESMStore has been set up.
+            void indexRefs();
+
             CellStore *getExterior (int x, int y);
 
             CellStore *getInterior (const std::string& name);
@@ -52,6 +71,12 @@ namespace MWWorld
             /// @note name must be lower case
             Ptr getPtr (const std::string& name);
 
+            /// Same as getPtr (name, cellStore, searchInContainers), with the ID
+            /// already interned (see ESMStore::getAtom).
+            Ptr getPtr (Atom atom, CellStore& cellStore, bool searchInContainers = false);
+
+            Ptr getPtr (Atom atom);
+
             /// Get all Ptrs referencing \a name in exterior cells
             /// @note Due to the current implementation of getPtr this only supports one Ptr per cell.
             /// @note name must be lower case
@@ -37,14 +37,24 @@ namespace MWWorld
     template <typename X>
     void CellRefList<X>::load(ESM::CellRef &ref, const MWWorld::ESMStore &esmStore)
     {
+        if (mRefnums.empty() && !mList.empty())
+        {
+            // Index the references that were added without load()
+            for (typename List::iterator iter (mList.begin()); iter!=mList.end(); ++iter)
+                mRefnums.insert (std::make_pair (iter->mRef.mRefnum, iter));
+        }
+
         // Get existing reference, in case we need to overwrite it.
-        typename std::list<LiveRef>::iterator iter = std::find(mList.begin(), mList.end(), ref.mRefnum);
+        typename RefnumIndex::iterator found = mRefnums.find (ref.mRefnum);
+        typename List::iterator iter = found != mRefnums.end() ? found->second : mList.end();
 
         // Skip this when reference was deleted.
         // TODO: Support respawning references, in this case, we need to track it somehow.
         if (ref.mDeleted) {
-            if (iter != mList.end())
+            if (iter != mList.end()) {
                 mList.erase(iter);
+                mRefnums.erase(found);
+            }
             return;
         }
 
@@ -60,15 +70,13 @@ namespace MWWorld
           if (iter != mList.end())
             *iter = LiveRef(ref, ptr);
           else
+          {
             mList.push_back(LiveRef(ref, ptr));
+            mRefnums.insert (std::make_pair (ref.mRefnum, --mList.end()));
+          }
         }
     }
 
-    template<typename X> bool operator==(const LiveCellRef<X>& ref, int pRefnum)
-    {
-        return (ref.mRef.mRefnum == pRefnum);
-    }
-
     CellStore::CellStore (const ESM::Cell *cell)
       : mCell (cell), mState (State_Unloaded)
     {
@@ -104,33 +112,46 @@ namespace MWWorld
     {
         assert (mCell);
 
-        if (mCell->mContextList.empty())
-            return; // this is a dynamically generated cell -> skipping.
+        listRefs (mCell, store, esm, mIds);
+
+        std::sort (mIds.begin(), mIds.end());
+    }
 
+    void CellStore::listRefs (const ESM::Cell *cell, const MWWorld::ESMStore &store,
+        std::vector<ESM::ESMReader> &esm, std::vector<Atom> &ids)
+    {
         // Load references from all plugins that do something with this cell.
-        for (size_t i = 0; i < mCell->mContextList.size(); i++)
+        for (size_t i = 0; i < cell->mContextList.size(); i++)
         {
             // Reopen the ESM reader and seek to the right position.
-            int index = mCell->mContextList.at(i).index;
-            mCell->restore (esm[index], i);
+            int index = cell->mContextList.at(i).index;
+            cell->restore (esm[index], i);
 
             ESM::CellRef ref;
 
             // Get each reference in turn
-            while (mCell->getNextRef (esm[index], ref))
+            while (cell->getNextRef (esm[index], ref))
             {
-                std::string lowerCase = Misc::StringUtils::lowerCase (ref.mRefID);
                 if (ref.mDeleted) {
                     // Right now, don't do anything. Where is "listRefs" actually used, anyway?
                     //  Skipping for now...
                     continue;
                 }
 
-                mIds.push_back (lowerCase);
+                // References to unknown records are not loaded either
+                Atom atom = store.getAtom (ref.mRefID);
+                if (atom != 0)
+                    ids.push_back (atom);
             }
         }
 
-        std::sort (mIds.begin(), mIds.end());
+        // loadRefs() adds these too
+        for (ESM::CellRefTracker::const_iterator it = cell->mLeasedRefs.begin(); it != cell->mLeasedRefs.end(); ++it)
+        {
+            Atom atom = store.getAtom (it->mRefID);
+            if (atom != 0)
+                ids.push_back (atom);
+        }
     }
 
     void CellStore::loadRefs(const MWWorld::ESMStore &store, std::vector<ESM::ESMReader> &esm)
@@ -140,6 +161,12 @@ namespace MWWorld
         if (mCell->mContextList.empty())
             return; // this is a dynamically generated cell -> skipping.
 
+        std::vector<int> movedRefs;
+        movedRefs.reserve (mCell->mMovedRefs.size());
+        for (ESM::MovedCellRefTracker::const_iterator iter = mCell->mMovedRefs.begin(); iter != mCell->mMovedRefs.end(); ++iter)
+            movedRefs.push_back (iter->mRefnum);
+        std::sort (movedRefs.begin(), movedRefs.end());
+
         // Load references from all plugins that do something with this cell.
         for (size_t i = 0; i < mCell->mContextList.size(); i++)
         {
@@ -153,12 +180,11 @@ namespace MWWorld
             while(mCell->getNextRef(esm[index], ref))
             {
                 // Don't load reference if it was moved to a different cell.
-                std::string lowerCase = Misc::StringUtils::lowerCase(ref.mRefID);
-                ESM::MovedCellRefTracker::const_iterator iter = std::find(mCell->mMovedRefs.begin(), mCell->mMovedRefs.end(), ref.mRefnum);
-                if (iter != mCell->mMovedRefs.end()) {
+                if (std::binary_search (movedRefs.begin(), movedRefs.end(), ref.mRefnum)) {
                     continue;
                 }
-                int rec = store.find(ref.mRefID);
+                std::string lowerCase = Misc::StringUtils::lowerCase(ref.mRefID);
+                int rec = store.find(store.getAtom(ref.mRefID));
 
                 ref.mRefID = lowerCase;
 
@@ -204,7 +230,7 @@ namespace MWWorld
             ESM::CellRef &ref = const_cast<ESM::CellRef&>(*it);
             //ESM::CellRef &ref = const_cast<ESM::CellRef&>(it->second);
 
-            int rec = store.find(ref.mRefID);
+            int rec = store.find(store.getAtom(ref.mRefID));
             Misc::StringUtils::toLower(ref.mRefID);
 
             /* We can optimize this further by storing the pointer to the
@@ -3,6 +3,13 @@
 
 #include <deque>
 #include <algorithm>
+#ifdef _WIN32
+#include <boost/tr1/tr1/unordered_map>
+#elif defined HAVE_UNORDERED_MAP
+#include <unordered_map>
+#else
+#include <tr1/unordered_map>
+#endif
 
 #include "livecellref.hpp"
 #include "esmstore.hpp"
@@ -18,6 +25,22 @@ namespace MWWorld
     typedef std::list<LiveRef> List;
     List mList;
 
+    // Position of each reference in mList by refnum, used by load()
+    typedef std::tr1::unordered_map<int, typename List::iterator> RefnumIndex;
+    RefnumIndex mRefnums;
+
+    CellRefList() {}
+
+    // The index points into mList, so it is rebuilt rather than copied
+    CellRefList (const CellRefList& list) : mList (list.mList) {}
+
+    CellRefList& operator= (const CellRefList& list)
+    {
+        mList = list.mList;
+        mRefnums.clear();
+        return *this;
+    }
+
     // Search for the given reference in the given reclist from
     // ESMStore. Insert the reference into the list if a match is
     // found. If not, throw an exception.
@@ -40,6 +63,8 @@ namespace MWWorld
 
     LiveRef &insert(const LiveRef &item) {
         mList.push_back(item);
+        if (!mRefnums.empty())
+            mRefnums.insert (std::make_pair (item.mRef.mRefnum, --mList.end()));
         return mList.back();
     }
   };
@@ -58,7 +83,7 @@ namespace MWWorld
 
     const ESM::Cell *mCell;
     State mState;
-    std::vector<std::string> mIds;
+    std::vector<Atom> mIds; ///< Sorted IDs of all references, while preloaded
 
     float mWaterLevel;
 
@@ -133,6 +158,11 @@ namespace MWWorld
 
     Ptr searchInContainer (const std::string& id);
 
+    /// Append the IDs of all references in \a cell to \a ids, including references
+    /// moved into the cell. References to unknown records are skipped.
+    static void listRefs (const ESM::Cell *cell, const MWWorld::ESMStore &store,
+        std::vector<ESM::ESMReader> &esm, std::vector<Atom> &ids);
+
   private:
 
     template<class Functor, class List>
@@ -27,6 +27,11 @@ struct ContentLoader
       mListener.setLabel(filepath.string());
     }
 
+    /// Called once all content files have been passed to load()
+    virtual void finish()
+    {
+    }
+
     protected:
         Loading::Listener& mListener;
 };
@@ -1,17 +1,32 @@
 #include "esmloader.hpp"
 #include "esmstore.hpp"
 
+#include <sstream>
+
+#include <boost/filesystem/operations.hpp>
+
 #include "components/to_utf8/to_utf8.hpp"
 
+#include "../config.hpp"
+
+namespace
+{
+  // Increase when the layout of the record cache changes
+  const int sCacheFormat = 1;
+}
+
 namespace MWWorld
 {
 
 EsmLoader::EsmLoader(MWWorld::ESMStore& store, std::vector<ESM::ESMReader>& readers,
-  ToUTF8::Utf8Encoder* encoder, Loading::Listener& listener)
+  ToUTF8::Utf8Encoder* encoder, Loading::Listener& listener, int threads,
+  const std::string& cacheFile)
   : ContentLoader(listener)
   , mStore(store)
   , mEsm(readers)
   , mEncoder(encoder)
+  , mThreads(threads)
+  , mCacheFile(cacheFile)
 {
 }
 
@@ -25,7 +40,95 @@ void EsmLoader::load(const boost::filesystem::path& filepath, int& index)
   lEsm.setGlobalReaderList(&mEsm);
   lEsm.open(filepath.string());
   mEsm[index] = lEsm;
-  mStore.load(mEsm[index], &mListener);
+
+  if (mThreads == 1 && mCacheFile.empty())
+    mStore.load(mEsm[index], &mListener);
+  else
+    mPending.push_back(&mEsm[index]);
+}
+
+void EsmLoader::finish()
+{
+  if (mPending.empty())
+    return;
+
+  std::string key;
+  if (!mCacheFile.empty())
+  {
+    key = getCacheKey();
+
+    for (std::vector<ESM::ESMReader*>::const_iterator it = mPending.begin(); it != mPending.end(); ++it)
+      mStore.resolveMasters(**it);
+
+    mListener.setLabel("");
+    try
+    {
+      if (mStore.readCache(mCacheFile, key, mEsm, &mListener))
+      {
+        mPending.clear();
+        return;
+      }
+    }
+    catch (std::exception& e)
+    {
+      // Start over from the content files, which also writes a new cache
+      std::cerr << "Failed to read record cache " << mCacheFile << ": " << e.what() << std::endl;
+      mStore.clear();
+    }
+  }
+
+  if (mThreads == 1)
+  {
+    for (std::vector<ESM::ESMReader*>::const_iterator it = mPending.begin(); it != mPending.end(); ++it)
+    {
+      mListener.setLabel(boost::filesystem::path((*it)->getContext().filename).filename().string());
+      mStore.load(**it, &mListener);
+    }
+  }
+  else
+  {
+    mListener.setLabel("");
+    mStore.load(mPending, &mListener, mThreads);
+  }
+  mPending.clear();
+
+  if (!mCacheFile.empty())
+  {
+    try
+    {
+      mStore.writeCache(mCacheFile, key);
+    }
+    catch (std::exception& e)
+    {
+      std::cerr << "Failed to write record cache " << mCacheFile << ": " << e.what() << std::endl;
+      boost::system::error_code ec;
+      boost::filesystem::remove(mCacheFile, ec);
+    }
+  }
+}
+
+std::string EsmLoader::getCacheKey()
+{
+  std::ostringstream key;
+  key << sCacheFormat << ' ' << OPENMW_VERSION << '\n';
+
+  // Fingerprint of the code page, as strings are cached after conversion
+  if (mEncoder)
+  {
+    char legacy[129];
+    for (int i = 0; i < 128; ++i)
+      legacy[i] = static_cast<char>(128 + i);
+    legacy[128] = 0;
+    key << mEncoder->getUtf8(legacy, 128) << '\n';
+  }
+
+  for (std::vector<ESM::ESMReader*>::const_iterator it = mPending.begin(); it != mPending.end(); ++it)
+  {
+    const std::string& file = (*it)->getContext().filename;
+    key << file << ' ' << boost::filesystem::file_size(file)
+        << ' ' << boost::filesystem::last_write_time(file) << '\n';
+  }
+  return key.str();
 }
 
 } /* namespace MWWorld */
@@ -2,6 +2,7 @@
 #define ESMLOADER_HPP
 
 #include <vector>
+#include <string>
 
 #include "contentloader.hpp"
 #include "components/esm/esmreader.hpp"
@@ -18,15 +19,31 @@ class ESMStore;
 
 struct EsmLoader : public ContentLoader
 {
+    /// \param threads Number of threads used to parse content files, 0 for one per
+    /// CPU core. With 1, every file is loaded right away by load(), otherwise
+    /// load() only opens the file and parsing is deferred to finish().
+    /// \param cacheFile Record cache (see ESMStore::writeCache). If the same content
+    /// files were loaded before, finish() reads the records from it instead of parsing
+    /// the files. Empty to disable.
     EsmLoader(MWWorld::ESMStore& store, std::vector<ESM::ESMReader>& readers,
-      ToUTF8::Utf8Encoder* encoder, Loading::Listener& listener);
+      ToUTF8::Utf8Encoder* encoder, Loading::Listener& listener, int threads = 1,
+      const std::string& cacheFile = "");
 
     void load(const boost::filesystem::path& filepath, int& index);
 
+    void finish();
+
     private:
+      /// Identifies the pending content files, their size and modification time,
+      /// the encoding and the engine version.
+      std::string getCacheKey();
+
       std::vector<ESM::ESMReader>& mEsm;
       MWWorld::ESMStore& mStore;
       ToUTF8::Utf8Encoder* mEncoder;
+      int mThreads;
+      std::string mCacheFile;
+      std::vector<ESM::ESMReader*> mPending;
 };
 
 } /* namespace MWWorld */
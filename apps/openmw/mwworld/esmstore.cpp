@@ -2,8 +2,14 @@
 
 #include <set>
 #include <iostream>
+#include <algorithm>
+#include <fstream>
 
 #include <boost/filesystem/operations.hpp>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/exception_ptr.hpp>
 
 #include <components/loadinglistener/loadinglistener.hpp>
 
@@ -23,14 +29,77 @@ static bool isCacheableRecord(int id)
     return false;
 }
 
-void ESMStore::load(ESM::ESMReader &esm, Loading::Listener* listener)
+struct ESMStore::StagedEntry
 {
-    listener->setProgressRange(1000);
+    int mType;
+    std::string mId;
+    bool mDeleted;
 
-    std::set<std::string> missing;
+    // Decoded record; 0 for deletions and for INFO records without a dialogue
+    StagedRecord *mRecord;
+};
 
-    ESM::Dialogue *dialogue = 0;
+struct ESMStore::StagedFile
+{
+    std::vector<StagedEntry> mEntries;
+
+    bool mDone;
+    boost::exception_ptr mError; // thrown by the worker, rethrown on the main thread
+
+    StagedFile()
+      : mDone(false)
+    {}
+
+    ~StagedFile()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        for (std::vector<StagedEntry>::iterator it = mEntries.begin(); it != mEntries.end(); ++it)
+            delete it->mRecord;
+        mEntries.clear();
+    }
+};
+
+struct ESMStore::StagingQueue
+{
+    boost::mutex mMutex;
+    boost::condition_variable mCondition;
+
+    const std::vector<ESM::ESMReader *> &mReaders;
+    std::vector<StagedFile> mFiles;
+    size_t mNext;
+    bool mAbort;
+
+    StagingQueue(const std::vector<ESM::ESMReader *> &readers)
+      : mReaders(readers), mFiles(readers.size()), mNext(0), mAbort(false)
+    {}
+};
+
+namespace
+{
+    // INFO records belong to the dialogue that was loaded right before them,
+    // which is only known once the staged file is merged.
+    struct StagedInfo : public StagedRecord
+    {
+        ESM::DialInfo mInfo;
+        ESM::Dialogue *mDialogue;
 
+        StagedInfo()
+          : mDialogue(0)
+        {}
+
+        virtual void merge()
+        {
+            mDialogue->mInfo.push_back(mInfo);
+        }
+    };
+}
+
+void ESMStore::resolveMasters(ESM::ESMReader &esm)
+{
     /// \todo Move this to somewhere else. ESMReader?
     // Cache parent esX files by tracking their indices in the global list of
     //  all files/readers used by the engine. This will greaty accelerate
@@ -58,6 +127,17 @@ void ESMStore::load(ESM::ESMReader &esm, Loading::Listener* listener)
         }
         mast.index = index;
     }
+}
+
+void ESMStore::load(ESM::ESMReader &esm, Loading::Listener* listener)
+{
+    listener->setProgressRange(1000);
+
+    std::set<std::string> missing;
+
+    ESM::Dialogue *dialogue = 0;
+
+    resolveMasters(esm);
 
     // Loop through all records
     while(esm.hasMoreRecs())
@@ -128,6 +208,284 @@ void ESMStore::load(ESM::ESMReader &esm, Loading::Listener* listener)
   */
 }
 
+void ESMStore::load(const std::vector<ESM::ESMReader *> &readers, Loading::Listener* listener,
+    unsigned int threads)
+{
+    listener->setProgressRange(1000);
+
+    // Master indices depend on the readers before each file, resolve them up front
+    for (std::vector<ESM::ESMReader *>::const_iterator it = readers.begin(); it != readers.end(); ++it)
+        resolveMasters(**it);
+
+    if (threads == 0)
+        threads = std::max(1u, boost::thread::hardware_concurrency());
+    threads = std::min(threads, static_cast<unsigned int>(readers.size()));
+
+    StagingQueue queue(readers);
+    boost::thread_group workers;
+
+    try
+    {
+        for (unsigned int i = 0; i < threads; ++i)
+            workers.create_thread(boost::bind(&ESMStore::stageFiles, this, &queue));
+
+        // Merge each file as soon as it is ready, while later ones are still being decoded
+        for (size_t i = 0; i < readers.size(); ++i)
+        {
+            StagedFile &file = queue.mFiles[i];
+            {
+                boost::unique_lock<boost::mutex> lock(queue.mMutex);
+                while (!file.mDone)
+                    queue.mCondition.wait(lock);
+            }
+
+            if (file.mError)
+                boost::rethrow_exception(file.mError);
+
+            merge(file);
+            file.clear();
+
+            listener->setProgress((i+1) * 1000 / readers.size());
+        }
+    }
+    catch (...)
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(queue.mMutex);
+            queue.mAbort = true;
+        }
+        workers.join_all();
+        throw;
+    }
+
+    workers.join_all();
+}
+
+void ESMStore::stageFiles(StagingQueue *queue)
+{
+    while (true)
+    {
+        size_t index;
+        {
+            boost::unique_lock<boost::mutex> lock(queue->mMutex);
+            if (queue->mAbort || queue->mNext >= queue->mReaders.size())
+                return;
+            index = queue->mNext++;
+        }
+
+        ESM::ESMReader &esm = *queue->mReaders[index];
+        StagedFile &file = queue->mFiles[index];
+
+        // The encoder keeps an output buffer, so every thread needs its own copy
+        ToUTF8::Utf8Encoder *sharedEncoder = esm.getEncoder();
+        boost::scoped_ptr<ToUTF8::Utf8Encoder> encoder;
+        if (sharedEncoder)
+        {
+            encoder.reset(new ToUTF8::Utf8Encoder(*sharedEncoder));
+            esm.setEncoder(encoder.get());
+        }
+
+        // Nothing may escape the thread, that would terminate the process
+        try
+        {
+            stage(esm, file);
+        }
+        catch (...)
+        {
+            file.mError = boost::current_exception();
+        }
+
+        esm.setEncoder(sharedEncoder);
+
+        {
+            boost::unique_lock<boost::mutex> lock(queue->mMutex);
+            file.mDone = true;
+        }
+        queue->mCondition.notify_all();
+    }
+}
+
+void ESMStore::stage(ESM::ESMReader &esm, StagedFile &file)
+{
+    // Mirrors load(): INFO records are only kept if the last record was a dialogue
+    bool hasDialogue = false;
+
+    while(esm.hasMoreRecs())
+    {
+        ESM::NAME n = esm.getRecName();
+        esm.getRecHeader();
+
+        StagedEntry entry;
+        entry.mType = n.val;
+        entry.mDeleted = false;
+        entry.mRecord = 0;
+
+        std::map<int, StoreBase *>::iterator it = mStores.find(n.val);
+
+        if (it == mStores.end()) {
+            if (n.val == ESM::REC_INFO) {
+                std::string id = esm.getHNOString("INAM");
+                if (hasDialogue) {
+                    StagedInfo *info = new StagedInfo;
+                    entry.mRecord = info;
+                    file.mEntries.push_back(entry);
+                    info->mInfo.mId = id;
+                    info->mInfo.load(esm);
+                    continue;
+                } else {
+                    esm.skipRecord();
+                }
+            } else if (n.val == ESM::REC_MGEF) {
+                entry.mRecord = mMagicEffects.stage (esm);
+            } else if (n.val == ESM::REC_SKIL) {
+                entry.mRecord = mSkills.stage (esm);
+            } else {
+                esm.skipRecord();
+                continue;
+            }
+        } else {
+            entry.mId = esm.getHNOString("NAME");
+            if (esm.isNextSub("DELE")) {
+                esm.skipRecord();
+                entry.mDeleted = true;
+            } else {
+                entry.mRecord = it->second->stage(esm, entry.mId);
+                hasDialogue = (n.val == ESM::REC_DIAL);
+            }
+        }
+        file.mEntries.push_back(entry);
+    }
+}
+
+void ESMStore::merge(StagedFile &file)
+{
+    ESM::Dialogue *dialogue = 0;
+
+    for (std::vector<StagedEntry>::iterator it = file.mEntries.begin(); it != file.mEntries.end(); ++it)
+    {
+        if (it->mType == ESM::REC_INFO) {
+            if (dialogue) {
+                StagedInfo *info = static_cast<StagedInfo *>(it->mRecord);
+                info->mDialogue = dialogue;
+                info->merge();
+            } else {
+                std::cerr << "error: info record without dialog" << std::endl;
+            }
+        } else if (it->mType == ESM::REC_MGEF || it->mType == ESM::REC_SKIL) {
+            it->mRecord->merge();
+        } else if (it->mDeleted) {
+            mStores[it->mType]->eraseStatic(it->mId);
+        } else {
+            it->mRecord->merge();
+
+            if (it->mType == ESM::REC_DIAL) {
+                dialogue = const_cast<ESM::Dialogue*>(mDialogs.find(it->mId));
+            } else {
+                dialogue = 0;
+            }
+            // Insert the reference into the global lookup
+            if (!it->mId.empty() && isCacheableRecord(it->mType)) {
+                mIds[it->mId] = it->mType;
+            }
+        }
+    }
+}
+
+void ESMStore::writeCache(const std::string &file, const std::string &key) const
+{
+    std::ofstream stream(file.c_str(), std::ios::binary);
+    if (!stream.is_open())
+        throw std::runtime_error("Failed to create record cache " + file);
+
+    // No encoder: strings are kept in UTF8, as they were converted on load
+    ESM::ESMWriter writer;
+    writer.setVersion();
+    writer.setFormat(0);
+    writer.setAuthor("OpenMW");
+    writer.setDescription("Record cache");
+    writer.save(stream);
+
+    writer.startRecord("CKEY");
+    writer.writeHNString("DATA", key);
+    writer.endRecord("CKEY");
+
+    for (std::map<int, StoreBase *>::const_iterator it = mStores.begin(); it != mStores.end(); ++it)
+        it->second->writeCache(writer, it->first);
+
+    mMagicEffects.writeCache(writer);
+    mSkills.writeCache(writer);
+
+    writer.startRecord("CIDS");
+    for (std::map<std::string, int>::const_iterator it = mIds.begin(); it != mIds.end(); ++it)
+    {
+        writer.writeHNString("NAME", it->first);
+        writer.writeHNT("INDX", it->second);
+    }
+    writer.endRecord("CIDS");
+
+    writer.close();
+
+    if (!stream)
+        throw std::runtime_error("Failed to write record cache " + file);
+}
+
+bool ESMStore::readCache(const std::string &file, const std::string &key,
+    std::vector<ESM::ESMReader> &readers, Loading::Listener* listener)
+{
+    if (!boost::filesystem::exists(file))
+        return false;
+
+    ESM::ESMReader esm;
+    esm.setEncoder(NULL);
+    esm.setGlobalReaderList(&readers);
+    esm.open(file);
+
+    if (!esm.hasMoreRecs() || esm.getRecName().toString() != "CKEY")
+        return false;
+    esm.getRecHeader();
+    if (esm.getHNString("DATA") != key)
+        return false;
+
+    listener->setProgressRange(1000);
+
+    ESM::Dialogue *dialogue = 0;
+
+    while(esm.hasMoreRecs())
+    {
+        ESM::NAME n = esm.getRecName();
+        esm.getRecHeader();
+
+        if (n.val == ESM::REC_INFO) {
+            if (!dialogue)
+                esm.fail("info record without dialog");
+            dialogue->mInfo.push_back(ESM::DialInfo());
+            dialogue->mInfo.back().mId = esm.getHNString("INAM");
+            dialogue->mInfo.back().load(esm);
+        } else if (n.val == ESM::REC_DIAL) {
+            std::string id = esm.getHNString("NAME");
+            mDialogs.load(esm, id);
+            dialogue = const_cast<ESM::Dialogue*>(mDialogs.find(id));
+        } else if (n.val == ESM::REC_MGEF) {
+            mMagicEffects.load(esm);
+        } else if (n.val == ESM::REC_SKIL) {
+            mSkills.load(esm);
+        } else if (n.toString() == "CIDS") {
+            while (esm.hasMoreSubs()) {
+                std::string id = esm.getHNString("NAME");
+                esm.getHNT(mIds[id], "INDX");
+            }
+        } else {
+            std::map<int, StoreBase *>::iterator it = mStores.find(n.val);
+            if (it == mStores.end())
+                esm.fail("Unknown record in record cache");
+            it->second->readCache(esm);
+        }
+        listener->setProgress(esm.getFileOffset() / (float)esm.getFileSize() * 1000);
+    }
+
+    return true;
+}
+
 void ESMStore::setUp()
 {
     std::map<int, StoreBase *>::iterator it = mStores.begin();
@@ -137,6 +495,15 @@ void ESMStore::setUp()
     mSkills.setUp();
     mMagicEffects.setUp();
     mAttributes.setUp();
+
+    for (it = mStores.begin(); it != mStores.end(); ++it) {
+        it->second->setUpAtoms(mAtoms);
+    }
+
+    mAtomTypes.assign(mAtoms.size() + 1, 0);
+    for (std::map<std::string, int>::const_iterator id = mIds.begin(); id != mIds.end(); ++id) {
+        addId(id->first, id->second);
+    }
 }
 
 } // end namespace
@@ -72,10 +72,39 @@ namespace MWWorld
         std::map<std::string, int> mIds;
         std::map<int, StoreBase *> mStores;
 
+        // Interned IDs of all records, and the record type of each atom in mIds
+        AtomTable mAtoms;
+        std::vector<int> mAtomTypes;
+
+        void addId(const std::string &id, int type) {
+            mIds[id] = type;
+
+            if (!mAtomTypes.empty()) {
+                Atom atom = mAtoms.intern(id);
+                if (atom >= mAtomTypes.size()) {
+                    mAtomTypes.resize(atom + 1, 0);
+                }
+                mAtomTypes[atom] = type;
+            }
+        }
+
         ESM::NPC mPlayerTemplate;
 
         unsigned int mDynamicCount;
 
+        struct StagedEntry;
+        struct StagedFile;
+        struct StagingQueue;
+
+        // Decode every record of a content file without modifying the store
+        void stage(ESM::ESMReader &esm, StagedFile &file);
+
+        // Worker thread body for load(readers, listener, threads)
+        void stageFiles(StagingQueue *queue);
+
+        // Apply the records of a staged content file, in the order they were read
+        void merge(StagedFile &file);
+
     public:
         /// \todo replace with SharedIterator<StoreBase>
         typedef std::map<int, StoreBase *>::const_iterator iterator;
@@ -98,6 +127,24 @@ namespace MWWorld
             return it->second;
         }
 
+        /// Record type of \a atom, or 0 if it is not the ID of a cell reference record.
+        int find(Atom atom) const
+        {
+            return atom < mAtomTypes.size() ? mAtomTypes[atom] : 0;
+        }
+
+        /// Atom of the record ID \a id (case-insensitive), or 0 if there is no
+        /// record with that ID. Does not allocate.
+        Atom getAtom(const std::string &id) const
+        {
+            return mAtoms.search(id);
+        }
+
+        const AtomTable &getAtoms() const
+        {
+            return mAtoms;
+        }
+
         ESMStore()
           : mDynamicCount(0)
         {
@@ -156,6 +203,17 @@ namespace MWWorld
             mNpcs.insert(mPlayerTemplate);
         }
 
+        /// Drop every record loaded so far. Must be called before setUp().
+        void clear ()
+        {
+            for (std::map<int, StoreBase *>::iterator it = mStores.begin(); it != mStores.end(); ++it)
+                it->second->clear();
+
+            mMagicEffects.clear();
+            mSkills.clear();
+            mIds.clear();
+        }
+
         void movePlayerRecord ()
         {
             mPlayerTemplate = *mNpcs.find("player");
@@ -163,8 +221,38 @@ namespace MWWorld
             mNpcs.insert(mPlayerTemplate);
         }
 
+        /// Defer reading the text of books and scripts until they are used,
+        /// see Store<T>::setLazy(). Has to be set before loading.
+        void setLazyLoading(bool lazy)
+        {
+            mBooks.setLazy(lazy);
+            mScripts.setLazy(lazy);
+        }
+
         void load(ESM::ESMReader &esm, Loading::Listener* listener);
 
+        /// Load several content files at once. Each file is decoded on one of
+        /// \a threads worker threads (0 = one per CPU core) and the results are
+        /// merged in the order of \a readers, which gives the same store as
+        /// calling load() for each file in turn.
+        void load(const std::vector<ESM::ESMReader *> &readers, Loading::Listener* listener,
+            unsigned int threads);
+
+        // Look up the index of each parent file in the global reader list
+        void resolveMasters(ESM::ESMReader &esm);
+
+        /// Write every record loaded so far to \a file, tagged with \a key.
+        /// Must be called before setUp().
+        void writeCache(const std::string &file, const std::string &key) const;
+
+        /// Load the records saved by writeCache() instead of parsing the content
+        /// files again. The content files still have to be open in \a readers
+        /// (the global reader list), since cells and land are read from them on
+        /// demand.
+        /// \return false if \a file does not exist or was saved with another key.
+        bool readCache(const std::string &file, const std::string &key,
+            std::vector<ESM::ESMReader> &readers, Loading::Listener* listener);
+
         template <class T>
         const Store<T> &get() const {
             throw std::runtime_error("Storage for this type not exist");
@@ -187,7 +275,7 @@ namespace MWWorld
             T *ptr = store.insert(record);
             for (iterator it = mStores.begin(); it != mStores.end(); ++it) {
                 if (it->second == &store) {
-                    mIds[ptr->mId] = it->first;
+                    addId(ptr->mId, it->first);
                 }
             }
             return ptr;
@@ -206,7 +294,7 @@ namespace MWWorld
             T *ptr = store.insertStatic(record);
             for (iterator it = mStores.begin(); it != mStores.end(); ++it) {
                 if (it->second == &store) {
-                    mIds[ptr->mId] = it->first;
+                    addId(ptr->mId, it->first);
                 }
             }
             return ptr;
@@ -238,7 +326,7 @@ namespace MWWorld
         record.mId = id.str();
 
         ESM::NPC *ptr = mNpcs.insert(record);
-        mIds[ptr->mId] = ESM::REC_NPC_;
+        addId(ptr->mId, ESM::REC_NPC_);
         return ptr;
     }
 
@@ -416,6 +416,17 @@ namespace MWWorld
     {
         std::string mesh = MWWorld::Class::get(ptr).getModel(ptr);
         Ogre::SceneNode* node = ptr.getRefData().getBaseNode();
+
+        if (mDetachedObjects.erase(node->getName()))
+        {
+            // Put the kept bodies back, where the object is now
+            mEngine->addRigidBody(mEngine->getRigidBody(node->getName()), false,
+                mEngine->getRigidBody(node->getName(), true));
+            moveObject(ptr);
+            rotateObject(ptr);
+            return;
+        }
+
         handleToMesh[node->getName()] = mesh;
         OEngine::Physic::RigidBody* body = mEngine->createAndAdjustRigidBody(
             mesh, node->getName(), node->getScale().x, node->getPosition(), node->getOrientation(), 0, 0, false, placeable);
@@ -424,6 +435,11 @@ namespace MWWorld
         mEngine->addRigidBody(body, true, raycastingBody);
     }
 
+    void PhysicsSystem::prepareObject (const std::string& mesh, float scale)
+    {
+        mEngine->prepareShape(mesh, scale);
+    }
+
     void PhysicsSystem::addActor (const Ptr& ptr)
     {
         std::string mesh = MWWorld::Class::get(ptr).getModel(ptr);
@@ -437,6 +453,16 @@ namespace MWWorld
         mEngine->removeCharacter(handle);
         mEngine->removeRigidBody(handle);
         mEngine->deleteRigidBody(handle);
+        mDetachedObjects.erase(handle);
+    }
+
+    void PhysicsSystem::detachObject (const std::string& handle)
+    {
+        if (mEngine->getRigidBody(handle) || mEngine->getRigidBody(handle, true))
+        {
+            mEngine->removeRigidBody(handle);
+            mDetachedObjects.insert(handle);
+        }
     }
 
     void PhysicsSystem::moveObject (const Ptr& ptr)
@@ -1,6 +1,8 @@
 #ifndef GAME_MWWORLD_PHYSICSSYSTEM_H
 #define GAME_MWWORLD_PHYSICSSYSTEM_H
 
+#include <set>
+
 #include <OgreVector3.h>
 
 #include <btBulletCollisionCommon.h>
@@ -36,6 +38,9 @@ namespace MWWorld
 
             void addActor (const MWWorld::Ptr& ptr);
 
+            void prepareObject (const std::string& mesh, float scale);
+            ///< Build the collision shape of \a mesh ahead of addObject or addActor.
+
             void addHeightField (float* heights,
                 int x, int y, float yoffset,
                 float triSize, float sqrtVerts);
@@ -45,6 +50,9 @@ namespace MWWorld
             // have to keep this as handle for now as unloadcell only knows scenenode names
             void removeObject (const std::string& handle);
 
+            void detachObject (const std::string& handle);
+            ///< Take an object out of the simulation, but keep its bodies for addObject to put back.
+
             void moveObject (const MWWorld::Ptr& ptr);
 
             void rotateObject (const MWWorld::Ptr& ptr);
@@ -88,6 +96,7 @@ namespace MWWorld
             OEngine::Render::OgreRenderer &mRender;
             OEngine::Physic::PhysicEngine* mEngine;
             std::map<std::string, std::string> handleToMesh;
+            std::set<std::string> mDetachedObjects;
 
             PtrVelocityList mMovementQueue;
             PtrVelocityList mMovementResults;
@@ -0,0 +1,164 @@
+#ifndef OPENMW_MWWORLD_RECORDINDEX_H
+#define OPENMW_MWWORLD_RECORDINDEX_H
+
+#include <cctype>
+#include <string>
+#include <vector>
+
+#include <components/misc/hash.hpp>
+
+namespace MWWorld
+{
+    /// \brief Case-insensitive hash table of records by ID
+    ///
+    /// Open addressing with linear probing, so a lookup does not allocate.
+    /// Keys are not copied: each key has to stay alive and unchanged while
+    /// it is in the index (e.g. the key of a std::map node), and must be
+    /// lower case.
+    template <class T>
+    class RecordIndex
+    {
+        struct Slot
+        {
+            size_t mHash;
+            const std::string *mKey; // 0 if the slot is empty
+            T *mRecord;
+        };
+
+        std::vector<Slot> mSlots;
+        size_t mSize;
+
+        static size_t hash(const std::string &id) {
+            // Over the lower case characters
+            Misc::Hash hash;
+            for (std::string::const_iterator it = id.begin(); it != id.end(); ++it) {
+                hash.add(static_cast<unsigned char>(std::tolower(static_cast<unsigned char>(*it))));
+            }
+            return static_cast<size_t>(hash.get());
+        }
+
+        static bool equal(const std::string &id, const std::string &key) {
+            if (id.size() != key.size()) {
+                return false;
+            }
+            std::string::const_iterator it = id.begin();
+            std::string::const_iterator kit = key.begin();
+            for (; it != id.end(); ++it, ++kit) {
+                if (std::tolower(static_cast<unsigned char>(*it)) != static_cast<unsigned char>(*kit)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        size_t findSlot(const std::string &id, size_t hash) const {
+            size_t mask = mSlots.size() - 1;
+            size_t i = hash & mask;
+            while (mSlots[i].mKey != 0) {
+                if (mSlots[i].mHash == hash && equal(id, *mSlots[i].mKey)) {
+                    break;
+                }
+                i = (i + 1) & mask;
+            }
+            return i;
+        }
+
+        void grow() {
+            std::vector<Slot> old;
+            old.swap(mSlots);
+
+            Slot empty = { 0, 0, 0 };
+            mSlots.resize(old.empty() ? 16 : old.size() * 2, empty);
+
+            size_t mask = mSlots.size() - 1;
+            for (typename std::vector<Slot>::const_iterator it = old.begin(); it != old.end(); ++it) {
+                if (it->mKey != 0) {
+                    size_t i = it->mHash & mask;
+                    while (mSlots[i].mKey != 0) {
+                        i = (i + 1) & mask;
+                    }
+                    mSlots[i] = *it;
+                }
+            }
+        }
+
+    public:
+        RecordIndex()
+          : mSize(0)
+        {}
+
+        /// Records are not copied along with their index.
+        RecordIndex(const RecordIndex &)
+          : mSize(0)
+        {}
+
+        RecordIndex &operator=(const RecordIndex &) {
+            clear();
+            return *this;
+        }
+
+        T *search(const std::string &id) const {
+            if (mSize == 0) {
+                return 0;
+            }
+            const Slot &slot = mSlots[findSlot(id, hash(id))];
+            return slot.mKey != 0 ? slot.mRecord : 0;
+        }
+
+        /// Add \a record under \a key, or replace the record already stored under it.
+        void insert(const std::string &key, T *record) {
+            // Keep the load factor below 3/4
+            if ((mSize + 1) * 4 > mSlots.size() * 3) {
+                grow();
+            }
+            size_t h = hash(key);
+            Slot &slot = mSlots[findSlot(key, h)];
+            if (slot.mKey == 0) {
+                ++mSize;
+            }
+            slot.mHash = h;
+            slot.mKey = &key;
+            slot.mRecord = record;
+        }
+
+        void erase(const std::string &id) {
+            if (mSize == 0) {
+                return;
+            }
+            size_t mask = mSlots.size() - 1;
+            size_t i = findSlot(id, hash(id));
+            if (mSlots[i].mKey == 0) {
+                return;
+            }
+            mSlots[i].mKey = 0;
+            --mSize;
+
+            // Move following entries of the probe sequence into the gap, so
+            // that lookups never stop early
+            size_t j = i;
+            while (true) {
+                j = (j + 1) & mask;
+                if (mSlots[j].mKey == 0) {
+                    break;
+                }
+                size_t home = mSlots[j].mHash & mask;
+                if (((j - home) & mask) >= ((j - i) & mask)) {
+                    mSlots[i] = mSlots[j];
+                    mSlots[j].mKey = 0;
+                    i = j;
+                }
+            }
+        }
+
+        void clear() {
+            mSlots.clear();
+            mSize = 0;
+        }
+
+        size_t size() const {
+            return mSize;
+        }
+    };
+}
+
+#endif
@@ -1,8 +1,13 @@
 #include "scene.hpp"
 
+#include <algorithm>
+#include <typeinfo>
+
 #include <OgreSceneNode.h>
 
 #include <components/nif/niffile.hpp>
+#include <components/bsa/vfs.hpp>
+#include <components/settings/settings.hpp>
 
 #include <libs/openengine/ogre/fader.hpp>
 
@@ -19,55 +24,120 @@
 #include "class.hpp"
 
 #include "cellfunctors.hpp"
+#include "cellpreloader.hpp"
 
 namespace
 {
+    // Objects closer to the player than this are inserted right away, when cells
+    // are inserted over several frames
+    const float sImmediateRadius = 2048.0f;
+
+    /// Order in which the objects of a list are inserted over several frames: by
+    /// distance times the weight, plus the bias.
+    struct InsertOrder
+    {
+        float mWeight;
+        float mBias;
+    };
+
+    const InsertOrder sStructures = { 1.0f, 0.0f };
+
+    // Small items are only noticed when close
+    const InsertOrder sItems = { 4.0f, 0.0f };
+
+    // Actors after everything else, for adjustPosition to find what they stand on
+    const InsertOrder sActors = { 1.0f, 1e7f };
+
+    // Rough size of the collision and raycasting bodies of an object, without the shared shape
+    const size_t sBodySize = 1024;
+
+    bool comparePending (const std::pair<float, MWWorld::Ptr>& left,
+        const std::pair<float, MWWorld::Ptr>& right)
+    {
+        // The next object to insert goes last
+        return left.first > right.first;
+    }
+
+    void insertObject(MWRender::RenderingManager& rendering, MWWorld::PhysicsSystem& physics,
+        const MWWorld::Ptr& ptr, MWWorld::Scene::CellActivity activity, MWWorld::Scene::HandleIndex& handles)
+    {
+        const MWWorld::Class& class_ = MWWorld::Class::get (ptr);
+
+        try
+        {
+            rendering.addObject(ptr);
+
+            if (activity>=MWWorld::Scene::Activity_Physics)
+            {
+                // This adds actors and animated objects to the mechanics as well
+                class_.insertObject(ptr, physics);
+
+                if (activity<MWWorld::Scene::Activity_AI)
+                    MWBase::Environment::get().getMechanicsManager()->remove(ptr);
+            }
+
+            float ax = Ogre::Radian(ptr.getRefData().getLocalRotation().rot[0]).valueDegrees();
+            float ay = Ogre::Radian(ptr.getRefData().getLocalRotation().rot[1]).valueDegrees();
+            float az = Ogre::Radian(ptr.getRefData().getLocalRotation().rot[2]).valueDegrees();
+            MWBase::Environment::get().getWorld()->localRotateObject(ptr, ax, ay, az);
+
+            MWBase::Environment::get().getWorld()->scaleObject(ptr, ptr.getCellRef().mScale);
+            class_.adjustPosition(ptr);
+        }
+        catch (const std::exception& e)
+        {
+            std::string error ("error during rendering: ");
+            std::cerr << error + e.what() << std::endl;
+        }
+
+        // Also when inserting failed half-way, as unloading the cell removes the node
+        if (Ogre::SceneNode *node = ptr.getRefData().getBaseNode())
+            handles[node->getName()] = ptr;
+    }
+
+    /// List the enabled references that are not in the scene.
+    struct ListMissingObjects
+    {
+        std::vector<MWWorld::Ptr> mObjects;
+
+        bool operator() (MWWorld::Ptr ptr)
+        {
+            if (ptr.getRefData().isEnabled() && !ptr.getRefData().getBaseNode())
+                mObjects.push_back (ptr);
+            return true;
+        }
+    };
 
     template<typename T>
     void insertCellRefList(MWRender::RenderingManager& rendering,
-        T& cellRefList, MWWorld::CellStore &cell, MWWorld::PhysicsSystem& physics, bool rescale, Loading::Listener* loadingListener)
+        T& cellRefList, MWWorld::CellStore &cell, MWWorld::PhysicsSystem& physics, bool rescale, Loading::Listener* loadingListener,
+        MWWorld::Scene::CellActivity activity, MWWorld::Scene::HandleIndex& handles,
+        std::vector<std::pair<float, MWWorld::Ptr> >* pending, const Ogre::Vector3& center, const InsertOrder& order)
     {
-        if (!cellRefList.mList.empty())
+        for (typename T::List::iterator it = cellRefList.mList.begin();
+            it != cellRefList.mList.end(); it++)
         {
-            const MWWorld::Class& class_ =
-                MWWorld::Class::get (MWWorld::Ptr (&*cellRefList.mList.begin(), &cell));
-            for (typename T::List::iterator it = cellRefList.mList.begin();
-                it != cellRefList.mList.end(); it++)
+            if (rescale)
             {
-                if (rescale)
-                {
-                    if (it->mRef.mScale<0.5)
-                        it->mRef.mScale = 0.5;
-                    else if (it->mRef.mScale>2)
-                        it->mRef.mScale = 2;
-                }
+                if (it->mRef.mScale<0.5)
+                    it->mRef.mScale = 0.5;
+                else if (it->mRef.mScale>2)
+                    it->mRef.mScale = 2;
+            }
 
-                if (it->mData.getCount() && it->mData.isEnabled())
-                {
-                    MWWorld::Ptr ptr (&*it, &cell);
-
-                    try
-                    {
-                        rendering.addObject(ptr);
-                        class_.insertObject(ptr, physics);
-
-                        float ax = Ogre::Radian(ptr.getRefData().getLocalRotation().rot[0]).valueDegrees();
-                        float ay = Ogre::Radian(ptr.getRefData().getLocalRotation().rot[1]).valueDegrees();
-                        float az = Ogre::Radian(ptr.getRefData().getLocalRotation().rot[2]).valueDegrees();
-                        MWBase::Environment::get().getWorld()->localRotateObject(ptr, ax, ay, az);
-
-                        MWBase::Environment::get().getWorld()->scaleObject(ptr, ptr.getCellRef().mScale);
-                        class_.adjustPosition(ptr);
-                    }
-                    catch (const std::exception& e)
-                    {
-                        std::string error ("error during rendering: ");
-                        std::cerr << error + e.what() << std::endl;
-                    }
-                }
+            if (it->mData.getCount() && it->mData.isEnabled())
+            {
+                MWWorld::Ptr ptr (&*it, &cell);
+
+                float distance = center.distance (Ogre::Vector3 (ptr.getRefData().getPosition().pos));
 
-                loadingListener->increaseProgress(1);
+                if (pending && distance>sImmediateRadius)
+                    pending->push_back (std::make_pair (distance*order.mWeight + order.mBias, ptr));
+                else
+                    insertObject (rendering, physics, ptr, activity, handles);
             }
+
+            loadingListener->increaseProgress(1);
         }
     }
 
@@ -78,37 +148,70 @@ namespace MWWorld
 {
 
     void Scene::update (float duration, bool paused){
+        insertPending();
+
         mRendering.update (duration, paused);
+
+        // The preloader keeps the files of pending objects and is cleared once they are in
+        if (mPreloader && !paused && !mPendingLock && mCurrentCell && mCurrentCell->mCell->isExterior())
+        {
+            const ESM::Position& pos =
+                MWBase::Environment::get().getWorld()->getPlayerPtr().getRefData().getPosition();
+
+            mPreloader->update (duration, Ogre::Vector3 (pos.pos),
+                mCurrentCell->mCell->getGridX(), mCurrentCell->mCell->getGridY());
+        }
     }
 
     void Scene::unloadCell (CellStoreCollection::iterator iter)
     {
         std::cout << "Unloading cell\n";
-        ListAndResetHandles functor;
 
-        (*iter)->forEach<ListAndResetHandles>(functor);
+        // Forget objects that were never inserted. Such a cell is not cached, as its static
+        // geometry is incomplete and restoreCell would not insert them either.
+        bool cache = mCacheBudget>0;
+
+        if (mPendingCells.erase (*iter))
+        {
+            PendingObjects::iterator pending = mPendingObjects.begin();
+            for (PendingObjects::iterator it = mPendingObjects.begin(); it!=mPendingObjects.end(); ++it)
+                if (it->second.getCell()!=*iter)
+                    *pending++ = *it;
+            mPendingObjects.erase (pending, mPendingObjects.end());
+
+            cache = false;
+        }
+
+        // Cached cells keep their objects, see cacheCell
+        if (!cache)
         {
-            // silence annoying g++ warning
-            for (std::vector<Ogre::SceneNode*>::const_iterator iter2 (functor.mHandles.begin());
-                iter2!=functor.mHandles.end(); ++iter2)
+            ListAndResetHandles functor;
+
+            (*iter)->forEach<ListAndResetHandles>(functor);
             {
-                Ogre::SceneNode* node = *iter2;
-                mPhysics->removeObject (node->getName());
+                // silence annoying g++ warning
+                for (std::vector<Ogre::SceneNode*>::const_iterator iter2 (functor.mHandles.begin());
+                    iter2!=functor.mHandles.end(); ++iter2)
+                {
+                    Ogre::SceneNode* node = *iter2;
+                    mPhysics->removeObject (node->getName());
+                    mHandles.erase (node->getName());
+                }
             }
         }
 
+        if (mActivity[*iter]>=Activity_Physics)
+            removeHeightField (*iter);
+
         if ((*iter)->mCell->isExterior())
-        {
-            ESM::Land* land =
-                MWBase::Environment::get().getWorld()->getStore().get<ESM::Land>().search(
-                    (*iter)->mCell->getGridX(),
-                    (*iter)->mCell->getGridY()
-                );
-            if (land)
-                mPhysics->removeHeightField( (*iter)->mCell->getGridX(), (*iter)->mCell->getGridY() );
-        }
+            mActiveExteriors.erase (std::make_pair ((*iter)->mCell->getGridX(), (*iter)->mCell->getGridY()));
+
+        mActivity.erase (*iter);
 
-        mRendering.removeCell(*iter);
+        if (cache)
+            cacheCell (*iter);
+        else
+            mRendering.removeCell(*iter);
 
         MWBase::Environment::get().getWorld()->getLocalScripts().clearCell (*iter);
 
@@ -118,43 +221,76 @@ namespace MWWorld
         mActiveCells.erase(*iter);
     }
 
-    void Scene::loadCell (Ptr::CellStore *cell, Loading::Listener* loadingListener)
+    void Scene::addHeightField (CellStore *cell)
+    {
+        if (!cell->mCell->isExterior())
+            return;
+
+        float verts = ESM::Land::LAND_SIZE;
+        float worldsize = ESM::Land::REAL_SIZE;
+
+        ESM::Land* land =
+            MWBase::Environment::get().getWorld()->getStore().get<ESM::Land>().search(
+                cell->mCell->getGridX(),
+                cell->mCell->getGridY()
+            );
+        if (land) {
+            mPhysics->addHeightField (
+                land->mLandData->mHeights,
+                cell->mCell->getGridX(),
+                cell->mCell->getGridY(),
+                0,
+                worldsize / (verts-1),
+                verts)
+            ;
+        }
+    }
+
+    void Scene::removeHeightField (CellStore *cell)
+    {
+        if (!cell->mCell->isExterior())
+            return;
+
+        ESM::Land* land =
+            MWBase::Environment::get().getWorld()->getStore().get<ESM::Land>().search(
+                cell->mCell->getGridX(),
+                cell->mCell->getGridY()
+            );
+        if (land)
+            mPhysics->removeHeightField( cell->mCell->getGridX(), cell->mCell->getGridY() );
+    }
+
+    void Scene::loadCell (Ptr::CellStore *cell, Loading::Listener* loadingListener, CellActivity activity)
     {
         std::pair<CellStoreCollection::iterator, bool> result = mActiveCells.insert(cell);
 
         if(result.second)
         {
-            float verts = ESM::Land::LAND_SIZE;
-            float worldsize = ESM::Land::REAL_SIZE;
+            mActivity[cell] = activity;
 
-            // Load terrain physics first...
             if (cell->mCell->isExterior())
-            {
-                ESM::Land* land =
-                    MWBase::Environment::get().getWorld()->getStore().get<ESM::Land>().search(
-                        cell->mCell->getGridX(),
-                        cell->mCell->getGridY()
-                    );
-                if (land) {
-                    mPhysics->addHeightField (
-                        land->mLandData->mHeights,
-                        cell->mCell->getGridX(),
-                        cell->mCell->getGridY(),
-                        0,
-                        worldsize / (verts-1),
-                        verts)
-                    ;
-                }
-            }
+                mActiveExteriors[std::make_pair (cell->mCell->getGridX(), cell->mCell->getGridY())] = cell;
+
+            // Load terrain physics first...
+            if (activity>=Activity_Physics)
+                addHeightField (cell);
 
             // ... then references. This is important for adjustPosition to work correctly.
-            /// \todo rescale depending on the state of a new GMST
-            insertCell (*cell, true, loadingListener);
+            if (!restoreCell (cell, loadingListener))
+            {
+                /// \todo rescale depending on the state of a new GMST
+                insertCell (*cell, true, loadingListener);
 
-            mRendering.cellAdded (cell);
+                // Pending statics are batched once the last object is in, see insertPending
+                mRendering.cellAdded (cell, mPendingCells.find (cell)==mPendingCells.end());
+            }
 
             mRendering.configureAmbient(*cell);
-            mRendering.requestMap(cell);
+
+            // Otherwise insertPending requests the map once all objects are inserted
+            if (mPendingCells.find (cell)==mPendingCells.end())
+                mRendering.requestMap(cell);
+
             mRendering.configureAmbient(*cell);
         }
 
@@ -199,6 +335,12 @@ namespace MWWorld
             unloadCell (active++);
         assert(mActiveCells.empty());
         mCurrentCell = NULL;
+
+        // The cells may be gone after this
+        clearCache();
+        mHandles.clear();
+
+        releasePending();
     }
 
     void Scene::changeCell (int X, int Y, const ESM::Position& position, bool adjustPlayerPos)
@@ -213,34 +355,17 @@ namespace MWWorld
         loadingListener->setLabel(loadingExteriorText);
 
         CellStoreCollection::iterator active = mActiveCells.begin();
-
-        // get the number of cells to unload
-        int numUnload = 0;
         while (active!=mActiveCells.end())
         {
             if ((*active)->mCell->isExterior())
             {
-                if (std::abs (X-(*active)->mCell->getGridX())<=1 &&
-                    std::abs (Y-(*active)->mCell->getGridY())<=1)
-                {
-                    // keep cells within the new 3x3 grid
-                    ++active;
-                    continue;
-                }
-            }
-            ++active;
-            ++numUnload;
-        }
+                int x = (*active)->mCell->getGridX();
+                int y = (*active)->mCell->getGridY();
 
-        active = mActiveCells.begin();
-        while (active!=mActiveCells.end())
-        {
-            if ((*active)->mCell->isExterior())
-            {
-                if (std::abs (X-(*active)->mCell->getGridX())<=1 &&
-                    std::abs (Y-(*active)->mCell->getGridY())<=1)
+                if (std::abs (X-x)<=mRenderRadius && std::abs (Y-y)<=mRenderRadius)
                 {
-                    // keep cells within the new 3x3 grid
+                    // keep cells within the new grid
+                    setCellActivity (*active, getCellActivity (x-X, y-Y));
                     ++active;
                     continue;
                 }
@@ -250,70 +375,37 @@ namespace MWWorld
 
         int refsToLoad = 0;
         // get the number of refs to load
-        for (int x=X-1; x<=X+1; ++x)
-            for (int y=Y-1; y<=Y+1; ++y)
-            {
-                CellStoreCollection::iterator iter = mActiveCells.begin();
-
-                while (iter!=mActiveCells.end())
-                {
-                    assert ((*iter)->mCell->isExterior());
-
-                    if (x==(*iter)->mCell->getGridX() &&
-                        y==(*iter)->mCell->getGridY())
-                        break;
-
-                    ++iter;
-                }
-
-                if (iter==mActiveCells.end())
+        for (int x=X-mRenderRadius; x<=X+mRenderRadius; ++x)
+            for (int y=Y-mRenderRadius; y<=Y+mRenderRadius; ++y)
+                if (mActiveExteriors.find (std::make_pair (x, y))==mActiveExteriors.end())
                     refsToLoad += countRefs(*MWBase::Environment::get().getWorld()->getExterior(x, y));
-            }
 
         loadingListener->setProgressRange(refsToLoad);
 
-        // Load cells
-        for (int x=X-1; x<=X+1; ++x)
-            for (int y=Y-1; y<=Y+1; ++y)
-            {
-                CellStoreCollection::iterator iter = mActiveCells.begin();
-
-                while (iter!=mActiveCells.end())
-                {
-                    assert ((*iter)->mCell->isExterior());
-
-                    if (x==(*iter)->mCell->getGridX() &&
-                        y==(*iter)->mCell->getGridY())
-                        break;
+        // Only the surroundings of the player are inserted now, the rest over the next frames
+        mDeferInserts = mInsertBudget>0;
+        mInsertCenter = Ogre::Vector3 (position.pos);
 
-                    ++iter;
-                }
-
-                if (iter==mActiveCells.end())
+        // Load cells
+        for (int x=X-mRenderRadius; x<=X+mRenderRadius; ++x)
+            for (int y=Y-mRenderRadius; y<=Y+mRenderRadius; ++y)
+                if (mActiveExteriors.find (std::make_pair (x, y))==mActiveExteriors.end())
                 {
                     CellStore *cell = MWBase::Environment::get().getWorld()->getExterior(x, y);
 
-                    loadCell (cell, loadingListener);
+                    loadCell (cell, loadingListener, getCellActivity (x-X, y-Y));
                 }
-            }
 
-        // find current cell
-        CellStoreCollection::iterator iter = mActiveCells.begin();
-
-        while (iter!=mActiveCells.end())
-        {
-            assert ((*iter)->mCell->isExterior());
-
-            if (X==(*iter)->mCell->getGridX() &&
-                Y==(*iter)->mCell->getGridY())
-                break;
+        mDeferInserts = false;
+        std::sort (mPendingObjects.begin(), mPendingObjects.end(), comparePending);
 
-            ++iter;
-        }
+        // find current cell
+        std::map<std::pair<int, int>, CellStore*>::iterator current =
+            mActiveExteriors.find (std::make_pair (X, Y));
 
-        assert (iter!=mActiveCells.end());
+        assert (current!=mActiveExteriors.end());
 
-        mCurrentCell = *iter;
+        mCurrentCell = current->second;
 
         // adjust player
         playerCellChange (mCurrentCell, position, adjustPlayerPos);
@@ -326,16 +418,148 @@ namespace MWWorld
         mCellChanged = true;
 
         loadingListener->removeWallpaper();
+
+        // The prepared cells are inserted now, or were not the right ones. Objects inserted
+        // over the next frames still need their files, which are parsed only once this way.
+        if (!mPendingObjects.empty() && !mPendingLock)
+        {
+            Nif::NIFFile::lockCache();
+            mPendingLock = true;
+        }
+
+        releasePending();
+
+        prefetchCells (X, Y);
+    }
+
+    void Scene::prefetchCells (int X, int Y)
+    {
+        // Cells that become active when the player crosses into a neighbouring cell. Only the
+        // references are listed; the cells themselves are loaded when they become active.
+        MWBase::World *world = MWBase::Environment::get().getWorld();
+        const ESMStore& store = world->getStore();
+        int radius = mRenderRadius+1;
+
+        std::vector<Atom> ids;
+
+        for (int x=X-radius; x<=X+radius; ++x)
+            for (int y=Y-radius; y<=Y+radius; ++y)
+                if (std::abs (x-X)==radius || std::abs (y-Y)==radius)
+                    if (const ESM::Cell *cell = store.get<ESM::Cell>().search (x, y))
+                        CellStore::listRefs (cell, store, world->getEsmReader(), ids);
+
+        std::sort (ids.begin(), ids.end());
+        ids.erase (std::unique (ids.begin(), ids.end()), ids.end());
+
+        PrefetchModels functor (mVFS);
+        for (std::vector<Atom>::const_iterator iter (ids.begin()); iter!=ids.end(); ++iter)
+            functor (*iter, store);
+    }
+
+    Scene::CellActivity Scene::getCellActivity (int dx, int dy) const
+    {
+        int distance = std::max (std::abs (dx), std::abs (dy));
+
+        if (distance<=mAIRadius)
+            return Activity_AI;
+
+        if (distance<=mPhysicsRadius)
+            return Activity_Physics;
+
+        return Activity_Rendered;
+    }
+
+    void Scene::setCellActivity (CellStore *cell, CellActivity activity)
+    {
+        CellActivity& current = mActivity[cell];
+
+        if (current==activity)
+            return;
+
+        MWBase::MechanicsManager *mechanics = MWBase::Environment::get().getMechanicsManager();
+
+        if (activity>=Activity_Physics && current>activity)
+        {
+            // Only the updates stop
+            mechanics->drop (cell);
+            current = activity;
+            return;
+        }
+
+        ListInsertedObjects functor;
+        cell->forEach (functor);
+
+        if (current>=Activity_Physics && activity>current)
+        {
+            // Only the updates start, for what Class::insertObject registers with the mechanics
+            for (std::vector<Ptr>::const_iterator iter (functor.mObjects.begin());
+                iter!=functor.mObjects.end(); ++iter)
+                if (Class::get (*iter).isActor() || iter->getTypeName()==typeid (ESM::Activator).name())
+                    mechanics->add (*iter);
+
+            current = activity;
+            return;
+        }
+
+        // Start over without collision and updates...
+        mechanics->drop (cell);
+
+        if (current>=Activity_Physics)
+        {
+            for (std::vector<Ptr>::const_iterator iter (functor.mObjects.begin());
+                iter!=functor.mObjects.end(); ++iter)
+                mPhysics->removeObject (iter->getRefData().getHandle());
+
+            removeHeightField (cell);
+
+            // Lights play their sound again when they get collision back
+            MWBase::Environment::get().getSoundManager()->stopSound (cell);
+        }
+
+        // ... and add them again, as far as the new activity wants
+        if (activity>=Activity_Physics)
+        {
+            addHeightField (cell);
+
+            for (std::vector<Ptr>::const_iterator iter (functor.mObjects.begin());
+                iter!=functor.mObjects.end(); ++iter)
+                Class::get (*iter).insertObject (*iter, *mPhysics);
+
+            if (activity<Activity_AI)
+                mechanics->drop (cell);
+        }
+
+        current = activity;
     }
 
     //We need the ogre renderer and a scene node.
-    Scene::Scene (MWRender::RenderingManager& rendering, PhysicsSystem *physics)
-    : mCurrentCell (0), mCellChanged (false), mPhysics(physics), mRendering(rendering)
+    Scene::Scene (MWRender::RenderingManager& rendering, PhysicsSystem *physics,
+        const Bsa::VFS& vfs)
+    : mCurrentCell (0), mCellChanged (false), mPhysics(physics), mRendering(rendering), mVFS(vfs),
+      mPreloader (0), mDeferInserts (false), mPendingLock (false), mInsertCenter (Ogre::Vector3::ZERO), mCacheSize (0)
     {
+        mInsertBudget = Settings::Manager::getFloat ("insertion budget", "Objects");
+
+        mCacheBudget = static_cast<size_t> (std::max (0, Settings::Manager::getInt ("cache size", "Cells"))) * 1024 * 1024;
+
+        // Collision needs to be rendered, and actors can't move without collision
+        mRenderRadius = std::max (0, Settings::Manager::getInt ("rendered radius", "Cells"));
+        mPhysicsRadius = std::max (0, std::min (Settings::Manager::getInt ("physics radius", "Cells"), mRenderRadius));
+        mAIRadius = std::max (0, std::min (Settings::Manager::getInt ("ai radius", "Cells"), mPhysicsRadius));
+
+        int threads = Settings::Manager::getInt ("preload threads", "Content");
+
+        if (threads>0)
+            mPreloader = new CellPreloader (mVFS, *mPhysics, threads,
+                Settings::Manager::getFloat ("preload lookahead", "Content"), mRenderRadius);
     }
 
     Scene::~Scene()
     {
+        if (mPendingLock)
+            Nif::NIFFile::unlockCache();
+
+        delete mPreloader;
     }
 
     bool Scene::hasCellChanged() const
@@ -428,6 +652,8 @@ namespace MWWorld
         mCellChanged = true;
         MWBase::Environment::get().getWorld ()->getFader ()->fadeIn(0.5);
 
+        releasePending();
+
         loadingListener->removeWallpaper();
     }
 
@@ -477,34 +703,231 @@ namespace MWWorld
 
     void Scene::insertCell (Ptr::CellStore &cell, bool rescale, Loading::Listener* loadingListener)
     {
+        CellActivity activity = mActivity[&cell];
+        PendingObjects* pending = mDeferInserts ? &mPendingObjects : 0;
+        size_t numPending = mPendingObjects.size();
+
         // Loop through all references in the cell
-        insertCellRefList(mRendering, cell.mActivators, cell, *mPhysics, rescale, loadingListener);
-        insertCellRefList(mRendering, cell.mPotions, cell, *mPhysics, rescale, loadingListener);
-        insertCellRefList(mRendering, cell.mAppas, cell, *mPhysics, rescale, loadingListener);
-        insertCellRefList(mRendering, cell.mArmors, cell, *mPhysics, rescale, loadingListener);
-        insertCellRefList(mRendering, cell.mBooks, cell, *mPhysics, rescale, loadingListener);
-        insertCellRefList(mRendering, cell.mClothes, cell, *mPhysics, rescale, loadingListener);
-        insertCellRefList(mRendering, cell.mContainers, cell, *mPhysics, rescale, loadingListener);
-        insertCellRefList(mRendering, cell.mDoors, cell, *mPhysics, rescale, loadingListener);
-        insertCellRefList(mRendering, cell.mIngreds, cell, *mPhysics, rescale, loadingListener);
-        insertCellRefList(mRendering, cell.mCreatureLists, cell, *mPhysics, rescale, loadingListener);
-        insertCellRefList(mRendering, cell.mItemLists, cell, *mPhysics, rescale, loadingListener);
-        insertCellRefList(mRendering, cell.mLights, cell, *mPhysics, rescale, loadingListener);
-        insertCellRefList(mRendering, cell.mLockpicks, cell, *mPhysics, rescale, loadingListener);
-        insertCellRefList(mRendering, cell.mMiscItems, cell, *mPhysics, rescale, loadingListener);
-        insertCellRefList(mRendering, cell.mProbes, cell, *mPhysics, rescale, loadingListener);
-        insertCellRefList(mRendering, cell.mRepairs, cell, *mPhysics, rescale, loadingListener);
-        insertCellRefList(mRendering, cell.mStatics, cell, *mPhysics, rescale, loadingListener);
-        insertCellRefList(mRendering, cell.mWeapons, cell, *mPhysics, rescale, loadingListener);
+        insertCellRefList(mRendering, cell.mActivators, cell, *mPhysics, rescale, loadingListener, activity, mHandles, pending, mInsertCenter, sStructures);
+        insertCellRefList(mRendering, cell.mPotions, cell, *mPhysics, rescale, loadingListener, activity, mHandles, pending, mInsertCenter, sItems);
+        insertCellRefList(mRendering, cell.mAppas, cell, *mPhysics, rescale, loadingListener, activity, mHandles, pending, mInsertCenter, sItems);
+        insertCellRefList(mRendering, cell.mArmors, cell, *mPhysics, rescale, loadingListener, activity, mHandles, pending, mInsertCenter, sItems);
+        insertCellRefList(mRendering, cell.mBooks, cell, *mPhysics, rescale, loadingListener, activity, mHandles, pending, mInsertCenter, sItems);
+        insertCellRefList(mRendering, cell.mClothes, cell, *mPhysics, rescale, loadingListener, activity, mHandles, pending, mInsertCenter, sItems);
+        insertCellRefList(mRendering, cell.mContainers, cell, *mPhysics, rescale, loadingListener, activity, mHandles, pending, mInsertCenter, sStructures);
+        insertCellRefList(mRendering, cell.mDoors, cell, *mPhysics, rescale, loadingListener, activity, mHandles, pending, mInsertCenter, sStructures);
+        insertCellRefList(mRendering, cell.mIngreds, cell, *mPhysics, rescale, loadingListener, activity, mHandles, pending, mInsertCenter, sItems);
+        insertCellRefList(mRendering, cell.mCreatureLists, cell, *mPhysics, rescale, loadingListener, activity, mHandles, pending, mInsertCenter, sActors);
+        insertCellRefList(mRendering, cell.mItemLists, cell, *mPhysics, rescale, loadingListener, activity, mHandles, pending, mInsertCenter, sItems);
+        insertCellRefList(mRendering, cell.mLights, cell, *mPhysics, rescale, loadingListener, activity, mHandles, pending, mInsertCenter, sStructures);
+        insertCellRefList(mRendering, cell.mLockpicks, cell, *mPhysics, rescale, loadingListener, activity, mHandles, pending, mInsertCenter, sItems);
+        insertCellRefList(mRendering, cell.mMiscItems, cell, *mPhysics, rescale, loadingListener, activity, mHandles, pending, mInsertCenter, sItems);
+        insertCellRefList(mRendering, cell.mProbes, cell, *mPhysics, rescale, loadingListener, activity, mHandles, pending, mInsertCenter, sItems);
+        insertCellRefList(mRendering, cell.mRepairs, cell, *mPhysics, rescale, loadingListener, activity, mHandles, pending, mInsertCenter, sItems);
+        insertCellRefList(mRendering, cell.mStatics, cell, *mPhysics, rescale, loadingListener, activity, mHandles, pending, mInsertCenter, sStructures);
+        insertCellRefList(mRendering, cell.mWeapons, cell, *mPhysics, rescale, loadingListener, activity, mHandles, pending, mInsertCenter, sItems);
         // Load NPCs and creatures _after_ everything else (important for adjustPosition to work correctly)
-        insertCellRefList(mRendering, cell.mCreatures, cell, *mPhysics, rescale, loadingListener);
-        insertCellRefList(mRendering, cell.mNpcs, cell, *mPhysics, rescale, loadingListener);
+        insertCellRefList(mRendering, cell.mCreatures, cell, *mPhysics, rescale, loadingListener, activity, mHandles, pending, mInsertCenter, sActors);
+        insertCellRefList(mRendering, cell.mNpcs, cell, *mPhysics, rescale, loadingListener, activity, mHandles, pending, mInsertCenter, sActors);
+
+        if (mPendingObjects.size()>numPending)
+            mPendingCells[&cell] = mPendingObjects.size()-numPending;
+    }
+
+    void Scene::insertPending()
+    {
+        if (mPendingObjects.empty())
+        {
+            if (mPendingLock)
+                releasePending();
+            return;
+        }
+
+        unsigned long start = mInsertTimer.getMicroseconds();
+
+        do
+        {
+            Ptr ptr = mPendingObjects.back().second;
+            mPendingObjects.pop_back();
+
+            // Scripts may have deleted, disabled or re-enabled it in the meantime
+            if (ptr.getRefData().getCount() && ptr.getRefData().isEnabled() &&
+                !ptr.getRefData().getBaseNode())
+                insertObject (mRendering, *mPhysics, ptr, mActivity[ptr.getCell()], mHandles);
+
+            std::map<CellStore*, size_t>::iterator cell = mPendingCells.find (ptr.getCell());
+
+            if (--cell->second==0)
+            {
+                mPendingCells.erase (cell);
+
+                // Batch the statics, and show all objects on the local map. The build counts
+                // against the budget like the insertions.
+                mRendering.cellCompleted (ptr.getCell());
+                mRendering.requestMap (ptr.getCell());
+            }
+        }
+        while (!mPendingObjects.empty() &&
+            mInsertTimer.getMicroseconds()-start < mInsertBudget*1000);
+
+        if (mPendingLock)
+            releasePending();
+    }
+
+    void Scene::releasePending()
+    {
+        if (!mPendingObjects.empty())
+            return;
+
+        if (mPendingLock)
+        {
+            Nif::NIFFile::unlockCache();
+            mPendingLock = false;
+        }
+
+        if (mPreloader)
+            mPreloader->clear();
+    }
+
+    void Scene::cacheCell (CellStore *cell)
+    {
+        CachedCell cached;
+        cached.mCell = cell;
+
+        ListInsertedObjects functor;
+        cell->forEach (functor);
+
+        for (std::vector<Ptr>::iterator iter (functor.mObjects.begin()); iter!=functor.mObjects.end(); ++iter)
+        {
+            std::string handle = iter->getRefData().getHandle();
+
+            mHandles.erase (handle);
+
+            if (Class::get (*iter).isActor())
+            {
+                // Actors walk off while the cell is not active; they are inserted again
+                mPhysics->removeObject (handle);
+                iter->getRefData().setBaseNode (0);
+            }
+            else
+            {
+                mPhysics->detachObject (handle);
+                cached.mObjects.push_back (*iter);
+            }
+        }
+
+        mRendering.detachCell (cell);
+
+        cached.mSize = mRendering.estimateMemoryUsage (cell) + cached.mObjects.size()*sBodySize;
+
+        mCachedCells.push_back (cached);
+        mCacheSize += cached.mSize;
+
+        while (mCacheSize>mCacheBudget && !mCachedCells.empty())
+            evictCell (mCachedCells.begin());
+    }
+
+    bool Scene::restoreCell (CellStore *cell, Loading::Listener* loadingListener)
+    {
+        std::list<CachedCell>::iterator cached = mCachedCells.begin();
+        while (cached!=mCachedCells.end() && cached->mCell!=cell)
+            ++cached;
+
+        if (cached==mCachedCells.end())
+            return false;
+
+        std::vector<Ptr> objects;
+        objects.swap (cached->mObjects);
+        mCacheSize -= cached->mSize;
+        mCachedCells.erase (cached);
+
+        CellActivity activity = mActivity[cell];
+
+        mRendering.attachCell (cell);
+
+        for (std::vector<Ptr>::iterator iter (objects.begin()); iter!=objects.end(); ++iter)
+        {
+            RefData& data = iter->getRefData();
+            Ogre::SceneNode *node = data.getBaseNode();
+
+            if (!node)
+                continue;
+
+            // Scripts may have deleted, disabled, moved or scaled it in the meantime, without
+            // the scene following. Insert it anew then.
+            if (!data.getCount() || !data.isEnabled() ||
+                node->getPosition()!=Ogre::Vector3 (data.getPosition().pos) ||
+                node->getScale().x!=iter->getCellRef().mScale)
+            {
+                removeObjectFromScene (*iter);
+                data.setBaseNode (0);
+                continue;
+            }
+
+            mHandles[node->getName()] = *iter;
+
+            if (activity>=Activity_Physics)
+            {
+                // Puts the kept bodies back, and adds animated objects to the mechanics
+                Class::get (*iter).insertObject (*iter, *mPhysics);
+
+                if (activity<Activity_AI)
+                    MWBase::Environment::get().getMechanicsManager()->remove (*iter);
+            }
+        }
+
+        // Actors, and whatever was enabled, moved here or changed
+        ListMissingObjects missing;
+        cell->forEach (missing);
+
+        for (std::vector<Ptr>::const_iterator iter (missing.mObjects.begin());
+            iter!=missing.mObjects.end(); ++iter)
+            insertObject (mRendering, *mPhysics, *iter, activity, mHandles);
+
+        loadingListener->increaseProgress (countRefs (*cell));
+
+        return true;
+    }
+
+    void Scene::evictCell (std::list<CachedCell>::iterator iter)
+    {
+        for (std::vector<Ptr>::iterator object (iter->mObjects.begin()); object!=iter->mObjects.end(); ++object)
+        {
+            if (Ogre::SceneNode *node = object->getRefData().getBaseNode())
+            {
+                mPhysics->removeObject (node->getName());
+                object->getRefData().setBaseNode (0);
+            }
+        }
+
+        mRendering.removeCell (iter->mCell);
+
+        mCacheSize -= iter->mSize;
+        mCachedCells.erase (iter);
+    }
+
+    void Scene::clearCache()
+    {
+        while (!mCachedCells.empty())
+            evictCell (mCachedCells.begin());
     }
 
     void Scene::addObjectToScene (const Ptr& ptr)
     {
+        std::map<CellStore*, CellActivity>::const_iterator activity = mActivity.find (ptr.getCell());
+
         mRendering.addObject(ptr);
-        MWWorld::Class::get(ptr).insertObject(ptr, *mPhysics);
+
+        if (Ogre::SceneNode *node = ptr.getRefData().getBaseNode())
+            mHandles[node->getName()] = ptr;
+
+        if (activity==mActivity.end() || activity->second>=Activity_Physics)
+        {
+            MWWorld::Class::get(ptr).insertObject(ptr, *mPhysics);
+
+            if (activity!=mActivity.end() && activity->second<Activity_AI)
+                MWBase::Environment::get().getMechanicsManager()->remove (ptr);
+        }
         MWBase::Environment::get().getWorld()->rotateObject(ptr, 0, 0, 0, true);
         MWBase::Environment::get().getWorld()->scaleObject(ptr, ptr.getCellRef().mScale);
     }
@@ -514,18 +937,31 @@ namespace MWWorld
         MWBase::Environment::get().getMechanicsManager()->remove (ptr);
         MWBase::Environment::get().getSoundManager()->stopSound3D (ptr);
         mPhysics->removeObject (ptr.getRefData().getHandle());
+        mHandles.erase (ptr.getRefData().getHandle());
         mRendering.removeObject (ptr);
     }
 
+    void Scene::updateObjectCell (const Ptr& old, const Ptr& cur)
+    {
+        mRendering.updateObjectCell (old, cur);
+
+        if (Ogre::SceneNode *node = cur.getRefData().getBaseNode())
+            mHandles[node->getName()] = cur;
+    }
+
+    Ptr Scene::searchPtrViaHandle (const std::string& handle) const
+    {
+        HandleIndex::const_iterator iter = mHandles.find (handle);
+
+        if (iter==mHandles.end())
+            return Ptr();
+
+        return iter->second;
+    }
+
     bool Scene::isCellActive(const CellStore &cell)
     {
-        CellStoreCollection::iterator active = mActiveCells.begin();
-        while (active != mActiveCells.end()) {
-            if (**active == cell) {
-                return true;
-            }
-            ++active;
-        }
-        return false;
+        // Cells owns exactly one CellStore per cell, so identity is enough here.
+        return mActiveCells.find (const_cast<CellStore*> (&cell))!=mActiveCells.end();
     }
 }
@@ -1,16 +1,24 @@
 #ifndef GAME_MWWORLD_SCENE_H
 #define GAME_MWWORLD_SCENE_H
 
+#include <list>
+
+#ifdef _WIN32
+#include <boost/tr1/tr1/unordered_map>
+#elif defined HAVE_UNORDERED_MAP
+#include <unordered_map>
+#else
+#include <tr1/unordered_map>
+#endif
+
+#include <OgreVector3.h>
+#include <OgreTimer.h>
+
 #include "../mwrender/renderingmanager.hpp"
 
 #include "ptr.hpp"
 #include "globals.hpp"
 
-namespace Ogre
-{
-    class Vector3;
-}
-
 namespace ESM
 {
     struct Position;
@@ -21,6 +29,11 @@ namespace Files
     class Collections;
 }
 
+namespace Bsa
+{
+    class VFS;
+}
+
 namespace Render
 {
     class OgreRenderer;
@@ -37,6 +50,7 @@ namespace MWWorld
     class PhysicsSystem;
     class Player;
     class CellStore;
+    class CellPreloader;
 
     class Scene
     {
@@ -44,31 +58,105 @@ namespace MWWorld
 
             typedef std::set<CellStore *> CellStoreCollection;
 
+            typedef std::tr1::unordered_map<std::string, Ptr> HandleIndex;
+
+            /// What an active cell takes part in, each including the ones before
+            enum CellActivity
+            {
+                Activity_Rendered,
+                Activity_Physics,
+                Activity_AI ///< Actors and animated objects are updated
+            };
+
         private:
 
             //OEngine::Render::OgreRenderer& mRenderer;
             CellStore* mCurrentCell; // the cell the player is in
             CellStoreCollection mActiveCells;
+            std::map<std::pair<int, int>, CellStore*> mActiveExteriors; // by grid index
+            std::map<CellStore*, CellActivity> mActivity; // of all active cells
+            int mRenderRadius;
+            int mPhysicsRadius;
+            int mAIRadius;
             bool mCellChanged;
             PhysicsSystem *mPhysics;
             MWRender::RenderingManager& mRendering;
+            const Bsa::VFS& mVFS;
+            CellPreloader *mPreloader; // 0 if preloading is disabled
+
+            // Objects of active cells waiting to be inserted, by priority; the next one last
+            typedef std::vector<std::pair<float, Ptr> > PendingObjects;
+            PendingObjects mPendingObjects;
+            std::map<CellStore*, size_t> mPendingCells; // number of pending objects
+            float mInsertBudget; // milliseconds per frame, 0 to insert cells at once
+            bool mDeferInserts;
+            bool mPendingLock; // the NIF cache is locked, keeping the files of pending objects
+            Ogre::Vector3 mInsertCenter;
+            Ogre::Timer mInsertTimer;
+
+            /// A recently unloaded cell, whose objects are kept out of the scene
+            struct CachedCell
+            {
+                CellStore *mCell;
+                std::vector<Ptr> mObjects; // that were in the scene, except actors
+                size_t mSize; // estimated bytes
+            };
+
+            std::list<CachedCell> mCachedCells; // the least recently unloaded first
+            size_t mCacheSize;
+            size_t mCacheBudget; // bytes, 0 to unload cells completely
+
+            HandleIndex mHandles; // objects in the scene, by the name of their scene node
 
             void playerCellChange (CellStore *cell, const ESM::Position& position,
                 bool adjustPlayerPos = true);
 
             void insertCell (Ptr::CellStore &cell, bool rescale, Loading::Listener* loadingListener);
 
+            void addHeightField (CellStore *cell);
+
+            void removeHeightField (CellStore *cell);
+
+            CellActivity getCellActivity (int dx, int dy) const;
+            ///< Activity of the exterior cell \a dx, \a dy cells away from the current one.
+
+            void setCellActivity (CellStore *cell, CellActivity activity);
+            ///< Change the activity of the active cell \a cell.
+
+            void insertPending();
+            ///< Insert pending objects, until the time budget of this frame is used up.
+
+            void releasePending();
+            ///< Drop the parsed files kept for pending objects, once there are none left.
+
+            void cacheCell (CellStore *cell);
+            ///< Take the objects of an unloaded cell out of the scene, keeping them for restoreCell.
+
+            bool restoreCell (CellStore *cell, Loading::Listener* loadingListener);
+            ///< Put a cached cell back into the scene.
+            /// \return Was the cell cached?
+
+            void evictCell (std::list<CachedCell>::iterator iter);
+            ///< Destroy the kept objects of a cached cell.
+
+            void clearCache();
+
             int countRefs (const Ptr::CellStore& cell);
 
+            void prefetchCells (int X, int Y);
+            ///< Start reading the models used by the cells around the active grid.
+
         public:
 
-            Scene (MWRender::RenderingManager& rendering, PhysicsSystem *physics);
+            Scene (MWRender::RenderingManager& rendering, PhysicsSystem *physics,
+                const Bsa::VFS& vfs);
 
             ~Scene();
 
             void unloadCell (CellStoreCollection::iterator iter);
 
-            void loadCell (CellStore *cell, Loading::Listener* loadingListener);
+            void loadCell (CellStore *cell, Loading::Listener* loadingListener,
+                CellActivity activity = Activity_AI);
 
             void changeCell (int X, int Y, const ESM::Position& position, bool adjustPlayerPos);
 
@@ -98,6 +186,12 @@ namespace MWWorld
             void removeObjectFromScene (const Ptr& ptr);
             ///< Remove an object from the scene, but not from the world model.
 
+            void updateObjectCell (const Ptr& old, const Ptr& cur);
+            ///< An object in the scene has been moved from the active cell of \a old to that of \a cur.
+
+            Ptr searchPtrViaHandle (const std::string& handle) const;
+            ///< \return The object in the scene with the Ogre handle \a handle; an empty Ptr if there is none.
+
             bool isCellActive(const CellStore &cell);
     };
 }
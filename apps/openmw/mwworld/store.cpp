@@ -1,10 +1,174 @@
 #include "store.hpp"
 #include "esmstore.hpp"
 
+namespace
+{
+    // File position of a record, as stored in a record cache
+#pragma pack(push,1)
+    struct CachedContext
+    {
+        uint32_t mLeftRec, mLeftSub;
+        uint64_t mLeftFile;
+        int32_t mRecName, mSubName;
+        int32_t mIndex;
+        int32_t mSubCached;
+        uint64_t mFilePos;
+    };
+#pragma pack(pop)
+
+    void writeCacheContext(ESM::ESMWriter &writer, const ESM::ESM_Context &context)
+    {
+        CachedContext data;
+        data.mLeftRec = context.leftRec;
+        data.mLeftSub = context.leftSub;
+        data.mLeftFile = context.leftFile;
+        data.mRecName = context.recName.val;
+        data.mSubName = context.subName.val;
+        data.mIndex = context.index;
+        data.mSubCached = context.subCached;
+        data.mFilePos = context.filePos;
+
+        writer.writeHNString("FNAM", context.filename);
+        writer.writeHNT("CTXT", data);
+    }
+
+    ESM::ESM_Context readCacheContext(ESM::ESMReader &esm)
+    {
+        ESM::ESM_Context context;
+        context.filename = esm.getHNString("FNAM");
+
+        CachedContext data;
+        esm.getHNT(data, "CTXT");
+        context.leftRec = data.mLeftRec;
+        context.leftSub = data.mLeftSub;
+        context.leftFile = static_cast<size_t>(data.mLeftFile);
+        context.recName.val = data.mRecName;
+        context.subName.val = data.mSubName;
+        context.index = data.mIndex;
+        context.subCached = data.mSubCached != 0;
+        context.filePos = static_cast<size_t>(data.mFilePos);
+        return context;
+    }
+
+    // CellRef::save() skips default values that getNextRef() does not
+    // restore, so write every field.
+    void writeCacheRef(ESM::ESMWriter &writer, const ESM::CellRef &ref)
+    {
+        writer.writeHNT("FRMR", ref.mRefnum);
+        writer.writeHNString("NAME", ref.mRefID);
+        writer.writeHNT("XSCL", ref.mScale);
+        writer.writeHNString("ANAM", ref.mOwner);
+        writer.writeHNString("BNAM", ref.mGlob);
+        writer.writeHNString("XSOL", ref.mSoul);
+        writer.writeHNString("CNAM", ref.mFaction);
+        writer.writeHNT("INDX", ref.mFactIndex);
+        writer.writeHNT("INTV", ref.mCharge);
+        writer.writeHNT("XCHG", ref.mEnchantmentCharge);
+        writer.writeHNT("NAM9", ref.mGoldValue);
+        writer.writeHNT("TELE", static_cast<int>(ref.mTeleport));
+        writer.writeHNT("DODT", ref.mDoorDest, 24);
+        writer.writeHNString("DNAM", ref.mDestCell);
+        writer.writeHNT("LOCK", ref.mLockLevel);
+        writer.writeHNString("KNAM", ref.mKey);
+        writer.writeHNString("TNAM", ref.mTrap);
+        writer.writeHNT("UNAM", ref.mReferenceBlocked);
+        writer.writeHNT("DELE", ref.mDeleted);
+        writer.writeHNT("FLTV", ref.mFltv);
+        writer.writeHNT("NAM0", ref.mNam0);
+        writer.writeHNT("DATA", ref.mPos, 24);
+    }
+
+    void readCacheRef(ESM::ESMReader &esm, ESM::CellRef &ref)
+    {
+        esm.getHNT(ref.mRefnum, "FRMR");
+        ref.mRefID = esm.getHNString("NAME");
+        esm.getHNT(ref.mScale, "XSCL");
+        ref.mOwner = esm.getHNString("ANAM");
+        ref.mGlob = esm.getHNString("BNAM");
+        ref.mSoul = esm.getHNString("XSOL");
+        ref.mFaction = esm.getHNString("CNAM");
+        esm.getHNT(ref.mFactIndex, "INDX");
+        esm.getHNT(ref.mCharge, "INTV");
+        esm.getHNT(ref.mEnchantmentCharge, "XCHG");
+        esm.getHNT(ref.mGoldValue, "NAM9");
+        int teleport;
+        esm.getHNT(teleport, "TELE");
+        ref.mTeleport = teleport != 0;
+        esm.getHNT(ref.mDoorDest, "DODT", 24);
+        ref.mDestCell = esm.getHNString("DNAM");
+        esm.getHNT(ref.mLockLevel, "LOCK");
+        ref.mKey = esm.getHNString("KNAM");
+        ref.mTrap = esm.getHNString("TNAM");
+        esm.getHNT(ref.mReferenceBlocked, "UNAM");
+        esm.getHNT(ref.mDeleted, "DELE");
+        esm.getHNT(ref.mFltv, "FLTV");
+        esm.getHNT(ref.mNam0, "NAM0");
+        esm.getHNT(ref.mPos, "DATA", 24);
+    }
+}
+
 namespace MWWorld {
 
+void Store<ESM::Land>::writeCache(ESM::ESMWriter &writer, int type) const
+{
+    for (std::vector<ESM::Land *>::const_iterator it = mStatic.begin(); it != mStatic.end(); ++it)
+    {
+        const ESM::Land &land = **it;
+
+        writer.startRecord("LAND");
+        land.save(writer);
+        writer.writeHNT("PLGN", land.mPlugin);
+        writer.writeHNT("DTYP", land.mDataTypes);
+        writeCacheContext(writer, land.mContext);
+        writer.endRecord("LAND");
+    }
+}
+
+void Store<ESM::Land>::readCache(ESM::ESMReader &esm)
+{
+    ESM::Land *ptr = new ESM::Land();
+
+    try
+    {
+        esm.getSubNameIs("INTV");
+        esm.getSubHeaderIs(8);
+        esm.getT(ptr->mX);
+        esm.getT(ptr->mY);
+        esm.getHNT(ptr->mFlags, "DATA");
+        esm.getHNT(ptr->mPlugin, "PLGN");
+        esm.getHNT(ptr->mDataTypes, "DTYP");
+        ptr->mContext = readCacheContext(esm);
+    }
+    catch (...)
+    {
+        delete ptr;
+        throw;
+    }
+
+    // The land data is read from the content file on demand
+    ptr->mEsm = &esm.getGlobalReaderList()->at(ptr->mPlugin);
+    ptr->mHasData = (ptr->mDataTypes & (ESM::Land::DATA_VNML|ESM::Land::DATA_VHGT|ESM::Land::DATA_WNAM)) != 0;
+
+    mStatic.push_back(ptr);
+}
+
 
 void Store<ESM::Cell>::load(ESM::ESMReader &esm, const std::string &id)
+{
+    StagedCell staged;
+    decode(esm, id, staged);
+    merge(staged);
+}
+
+StagedRecord *Store<ESM::Cell>::stage(ESM::ESMReader &esm, const std::string &id)
+{
+    StagedStoreRecord<Store<ESM::Cell>, StagedCell> *staged =
+        new StagedStoreRecord<Store<ESM::Cell>, StagedCell>(*this);
+    decode(esm, id, staged->mRecord);
+    return staged;
+}
+
+void Store<ESM::Cell>::decode(ESM::ESMReader &esm, const std::string &id, StagedCell &staged)
 {
     // Don't automatically assume that a new cell must be spawned. Multiple plugins write to the same cell,
     //  and we merge all this data into one Cell object. However, we can't simply search for the cell id,
@@ -12,8 +176,7 @@ void Store<ESM::Cell>::load(ESM::ESMReader &esm, const std::string &id)
     //  are not available until both cells have been loaded! So first, proceed as usual.
     
     // All cells have a name record, even nameless exterior cells.
-    std::string idLower = Misc::StringUtils::lowerCase(id);
-    ESM::Cell *cell = new ESM::Cell;
+    ESM::Cell *cell = &staged.mCell;
     cell->mName = id;
 
     //First part of cell loading
@@ -25,9 +188,6 @@ void Store<ESM::Cell>::load(ESM::ESMReader &esm, const std::string &id)
         ESM::MovedCellRef cMRef;
         cell->getNextMVRF(esm, cMRef);
 
-        MWWorld::Store<ESM::Cell> &cStore = const_cast<MWWorld::Store<ESM::Cell>&>(mEsmStore->get<ESM::Cell>());
-        ESM::Cell *cellAlt = const_cast<ESM::Cell*>(cStore.searchOrCreate(cMRef.mTarget[0], cMRef.mTarget[1]));
-
         // Get regular moved reference data. Adapted from CellStore::loadRefs. Maybe we can optimize the following
         //  implementation when the oher implementation works as well.
         cell->getNextRef(esm, ref);
@@ -35,6 +195,26 @@ void Store<ESM::Cell>::load(ESM::ESMReader &esm, const std::string &id)
         // Add data required to make reference appear in the correct cell.
         // We should not need to test for duplicates, as this part of the code is pre-cell merge.
         cell->mMovedRefs.push_back(cMRef);
+        staged.mMovedRefData.push_back(ref);
+    }
+
+    //Second part of cell loading
+    cell->postLoad(esm);
+}
+
+void Store<ESM::Cell>::merge(StagedCell &staged)
+{
+    ESM::Cell *cell = &staged.mCell;
+    std::string idLower = Misc::StringUtils::lowerCase(cell->mName);
+
+    std::vector<ESM::CellRef>::const_iterator refIter = staged.mMovedRefData.begin();
+    for (ESM::MovedCellRefTracker::const_iterator it = cell->mMovedRefs.begin(); it != cell->mMovedRefs.end(); ++it, ++refIter) {
+        const ESM::MovedCellRef &cMRef = *it;
+        const ESM::CellRef &ref = *refIter;
+
+        MWWorld::Store<ESM::Cell> &cStore = const_cast<MWWorld::Store<ESM::Cell>&>(mEsmStore->get<ESM::Cell>());
+        ESM::Cell *cellAlt = const_cast<ESM::Cell*>(cStore.searchOrCreate(cMRef.mTarget[0], cMRef.mTarget[1]));
+
         // But there may be duplicates here!
         ESM::CellRefTracker::iterator iter = std::find(cellAlt->mLeasedRefs.begin(), cellAlt->mLeasedRefs.end(), ref.mRefnum);
         if (iter == cellAlt->mLeasedRefs.end())
@@ -43,9 +223,6 @@ void Store<ESM::Cell>::load(ESM::ESMReader &esm, const std::string &id)
           *iter = ref;
     }
 
-    //Second part of cell loading
-    cell->postLoad(esm);
-
     if(cell->mData.mFlags & ESM::Cell::Interior)
     {
         // Store interior cell by name, try to merge with existing parent data.
@@ -87,7 +264,80 @@ void Store<ESM::Cell>::load(ESM::ESMReader &esm, const std::string &id)
         } else
             mExt[std::make_pair(cell->mData.mX, cell->mData.mY)] = *cell;
     }
-    delete cell;
+}
+
+void Store<ESM::Cell>::writeCache(ESM::ESMWriter &writer, int type) const
+{
+    std::vector<const ESM::Cell *> cells;
+    for (DynamicInt::const_iterator it = mInt.begin(); it != mInt.end(); ++it)
+        cells.push_back(&it->second);
+    for (DynamicExt::const_iterator it = mExt.begin(); it != mExt.end(); ++it)
+        cells.push_back(&it->second);
+
+    for (std::vector<const ESM::Cell *>::const_iterator it = cells.begin(); it != cells.end(); ++it)
+    {
+        const ESM::Cell &cell = **it;
+
+        writer.startRecord("CELL");
+        writer.writeHNString("NAME", cell.mName);
+        cell.save(writer);
+
+        for (std::vector<ESM::ESM_Context>::const_iterator ctx = cell.mContextList.begin();
+             ctx != cell.mContextList.end(); ++ctx)
+        {
+            writeCacheContext(writer, *ctx);
+        }
+
+        for (ESM::MovedCellRefTracker::const_iterator ref = cell.mMovedRefs.begin();
+             ref != cell.mMovedRefs.end(); ++ref)
+        {
+            writer.writeHNT("MVRF", ref->mRefnum);
+            writer.writeHNT("CNDT", ref->mTarget);
+        }
+
+        for (ESM::CellRefTracker::const_iterator ref = cell.mLeasedRefs.begin();
+             ref != cell.mLeasedRefs.end(); ++ref)
+        {
+            writeCacheRef(writer, *ref);
+        }
+
+        writer.endRecord("CELL");
+    }
+}
+
+void Store<ESM::Cell>::readCache(ESM::ESMReader &esm)
+{
+    ESM::Cell cell;
+    cell.mName = esm.getHNString("NAME");
+    cell.load(esm, false);
+
+    // Cells are stored already merged, with the contexts and references
+    // of all the content files that contributed to them
+    while (esm.isNextSub("FNAM"))
+    {
+        esm.cacheSubName();
+        cell.mContextList.push_back(readCacheContext(esm));
+    }
+
+    while (esm.isNextSub("MVRF"))
+    {
+        ESM::MovedCellRef ref;
+        esm.getHT(ref.mRefnum);
+        esm.getHNT(ref.mTarget, "CNDT");
+        cell.mMovedRefs.push_back(ref);
+    }
+
+    while (esm.isNextSub("FRMR"))
+    {
+        esm.cacheSubName();
+        cell.mLeasedRefs.push_back(ESM::CellRef());
+        readCacheRef(esm, cell.mLeasedRefs.back());
+    }
+
+    if (cell.mData.mFlags & ESM::Cell::Interior)
+        mInt[Misc::StringUtils::lowerCase(cell.mName)] = cell;
+    else
+        mExt[std::make_pair(cell.mData.mX, cell.mData.mY)] = cell;
 }
 
 }
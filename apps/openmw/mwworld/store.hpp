@@ -5,23 +5,104 @@
 #include <vector>
 #include <map>
 #include <stdexcept>
+#ifdef _WIN32
+#include <boost/tr1/tr1/unordered_map>
+#elif defined HAVE_UNORDERED_MAP
+#include <unordered_map>
+#else
+#include <tr1/unordered_map>
+#endif
+
+#include <components/esm/esmwriter.hpp>
 
 #include "recordcmp.hpp"
+#include "recordindex.hpp"
+#include "atomtable.hpp"
 
 namespace MWWorld
 {
+    /// \brief Record that has been decoded without touching its store
+    ///
+    /// Used to parse several content files at once. Calling merge() on the
+    /// staged records in load order has the same effect as loading them
+    /// with StoreBase::load().
+    struct StagedRecord
+    {
+        virtual ~StagedRecord() {}
+
+        virtual void merge() = 0;
+    };
+
+    template <class S, class R>
+    class StagedStoreRecord : public StagedRecord
+    {
+        S &mStore;
+
+    public:
+        R mRecord;
+
+        StagedStoreRecord(S &store)
+          : mStore(store), mRecord()
+        {}
+
+        virtual void merge() {
+            mStore.merge(mRecord);
+        }
+    };
+
+    /// Record of which only the file position has been read, see Store<T>::setLazy()
+    template <class S>
+    class StagedLazyRecord : public StagedRecord
+    {
+        S &mStore;
+        std::string mId;
+        ESM::ESMReader &mReader;
+        ESM::ESM_Context mContext;
+
+    public:
+        StagedLazyRecord(S &store, const std::string &id, ESM::ESMReader &esm,
+            const ESM::ESM_Context &context)
+          : mStore(store), mId(id), mReader(esm), mContext(context)
+        {}
+
+        virtual void merge() {
+            mStore.mergeLazy(mId, mReader, mContext);
+        }
+    };
+
     struct StoreBase
     {
         virtual ~StoreBase() {}
 
         virtual void setUp() {}
+
+        /// Intern the ID of every record and index the records by atom.
+        /// Called after setUp().
+        virtual void setUpAtoms(AtomTable &atoms) {}
         virtual void listIdentifier(std::vector<std::string> &list) const {}
 
         virtual size_t getSize() const = 0;
         virtual void load(ESM::ESMReader &esm, const std::string &id) = 0;
 
+        /// Decode a record the way load() would, but without modifying the
+        /// store. Safe to call from a worker thread. The caller takes
+        /// ownership of the result.
+        virtual StagedRecord *stage(ESM::ESMReader &esm, const std::string &id) = 0;
+
+        /// Write the loaded records to a record cache (see ESMStore::writeCache).
+        virtual void writeCache(ESM::ESMWriter &writer, int type) const = 0;
+
+        /// Read back one record written by writeCache(). Record name and
+        /// header have already been read.
+        virtual void readCache(ESM::ESMReader &esm) {
+            load(esm, esm.getHNOString("NAME"));
+        }
+
         virtual bool eraseStatic(const std::string &id) {return false;}
         virtual void clearDynamic() {}
+
+        /// Drop all records, e.g. when reading a record cache failed half-way.
+        virtual void clear() = 0;
     };
 
     template <class T>
@@ -95,6 +176,97 @@ namespace MWWorld
         typedef std::map<std::string, T> Dynamic;
         typedef std::map<std::string, T> Static;
 
+        // Hashed views of mStatic and mDynamic, used by search()
+        RecordIndex<T> mStaticIndex;
+        RecordIndex<T> mDynamicIndex;
+
+        // Records by atom, once setUpAtoms() has been called
+        AtomTable *mAtoms;
+        std::vector<const T *> mByAtom;
+
+        struct LazyRecord
+        {
+            ESM::ESMReader *mReader;
+            ESM::ESM_Context mContext;
+        };
+
+        typedef std::tr1::unordered_map<const T *, LazyRecord> LazyRecords;
+
+        // Static records whose body has not been read yet
+        bool mLazy;
+        mutable LazyRecords mLazyRecords;
+
+        // Read the body of \a record, if it was loaded lazily
+        const T *decode(const T *record) const {
+            if (record != 0 && !mLazyRecords.empty()) {
+                typename LazyRecords::iterator it = mLazyRecords.find(record);
+                if (it != mLazyRecords.end()) {
+                    decode(it);
+                }
+            }
+            return record;
+        }
+
+        void decode(typename LazyRecords::iterator it) const {
+            T &record = const_cast<T &>(*it->first);
+            ESM::ESMReader &esm = *it->second.mReader;
+
+            // The reader may be in use, e.g. by a cell that is being loaded
+            ESM::ESM_Context current = esm.getContext();
+            esm.restoreContext(it->second.mContext);
+
+            std::string id = record.mId;
+            record.load(esm);
+            record.mId = id;
+            mLazyRecords.erase(it);
+
+            if (!current.filename.empty()) {
+                esm.restoreContext(current);
+            }
+        }
+
+        void decodeAll() const {
+            while (!mLazyRecords.empty()) {
+                decode(mLazyRecords.begin());
+            }
+        }
+
+        // Remember where the body of \a record is and skip it
+        void defer(const T &record, ESM::ESMReader &esm) {
+            LazyRecord &lazy = mLazyRecords[&record];
+            lazy.mReader = &esm;
+            lazy.mContext = esm.getContext();
+            esm.skipRecord();
+        }
+
+        void setAtom(Atom atom, const T *record) {
+            if (atom >= mByAtom.size()) {
+                mByAtom.resize(atom + 1, 0);
+            }
+            mByAtom[atom] = record;
+        }
+
+        // Point the atom of \a id back to the static record, if any
+        void resetAtom(const std::string &id) {
+            if (mAtoms != 0) {
+                Atom atom = mAtoms->search(id);
+                if (atom != 0 && atom < mByAtom.size()) {
+                    mByAtom[atom] = mStaticIndex.search(id);
+                }
+            }
+        }
+
+        // Returns the static record with the lower case id \a key, adding an
+        // empty one if there is none yet
+        T &getStatic(const std::string &key) {
+            typename Static::iterator it = mStatic.find(key);
+            if (it == mStatic.end()) {
+                it = mStatic.insert(std::make_pair(key, T())).first;
+                mStaticIndex.insert(it->first, &it->second);
+            }
+            return it->second;
+        }
+
         class GetRecords {
             const std::string mFind;
             std::vector<const T*> *mRecords;
@@ -116,37 +288,66 @@ namespace MWWorld
 
     public:
         Store()
+          : mAtoms(0), mLazy(false)
         {}
 
         Store(const Store<T> &orig)
-          : mStatic(orig.mData)
+          : mStatic(orig.mData), mAtoms(0), mLazy(false)
         {}
 
+        /// Only read the id of each record while loading, and the rest of the
+        /// record the first time it is looked up (or on iteration). The
+        /// readers have to stay open.
+        void setLazy(bool lazy) {
+            mLazy = lazy;
+        }
+
         typedef SharedIterator<T> iterator;
 
         // setUp needs to be called again after
         virtual void clearDynamic()
         {
+            typename Dynamic::const_iterator it = mDynamic.begin();
+            for (; it != mDynamic.end(); ++it) {
+                resetAtom(it->first);
+            }
             mDynamic.clear();
+            mDynamicIndex.clear();
             mShared.clear();
         }
 
-        const T *search(const std::string &id) const {
-            T item;
-            item.mId = Misc::StringUtils::lowerCase(id);
-
-            typename std::map<std::string, T>::const_iterator it = mStatic.find(item.mId);
+        virtual void clear()
+        {
+            mStatic.clear();
+            mStaticIndex.clear();
+            mDynamic.clear();
+            mDynamicIndex.clear();
+            mShared.clear();
+            mByAtom.clear();
+            mLazyRecords.clear();
+        }
 
-            if (it != mStatic.end() && Misc::StringUtils::ciEqual(it->second.mId, id)) {
-                return &(it->second);
+        const T *search(const std::string &id) const {
+            const T *ptr = mStaticIndex.search(id);
+            if (ptr == 0) {
+                ptr = mDynamicIndex.search(id);
             }
+            return decode(ptr);
+        }
 
-            typename Dynamic::const_iterator dit = mDynamic.find(item.mId);
-            if (dit != mDynamic.end()) {
-                return &dit->second;
-            }
+        /// Look up a record by its interned ID. Only valid after setUpAtoms().
+        const T *search(Atom atom) const {
+            return atom < mByAtom.size() ? decode(mByAtom[atom]) : 0;
+        }
 
-            return 0;
+        const T *find(Atom atom) const {
+            const T *ptr = search(atom);
+            if (ptr == 0) {
+                std::ostringstream msg;
+                msg << "Object '" << (atom != 0 ? mAtoms->getId(atom) : "") << "' not found (const)";
+                throw std::runtime_error(msg.str());
+            }
+            return ptr;
         }
 
         /** Returns a random record that starts with the named ID, or NULL if not found. */
@@ -155,7 +356,7 @@ namespace MWWorld
             std::vector<const T*> results;
             std::for_each(mShared.begin(), mShared.end(), GetRecords(id, &results));
             if(!results.empty())
-                return results[int(std::rand()/((double)RAND_MAX+1)*results.size())];
+                return decode(results[int(std::rand()/((double)RAND_MAX+1)*results.size())]);
             return NULL;
         }
 
@@ -185,9 +386,69 @@ namespace MWWorld
 
         void load(ESM::ESMReader &esm, const std::string &id) {
             std::string idLower = Misc::StringUtils::lowerCase(id);
-            mStatic[idLower] = T();
-            mStatic[idLower].mId = idLower;
-            mStatic[idLower].load(esm);
+            T &record = getStatic(idLower);
+            record = T();
+            record.mId = idLower;
+
+            if (mLazy) {
+                defer(record, esm);
+            } else {
+                mLazyRecords.erase(&record);
+                record.load(esm);
+            }
+        }
+
+        void readCache(ESM::ESMReader &esm) {
+            // The cache reader is closed after loading
+            bool lazy = mLazy;
+            mLazy = false;
+            load(esm, esm.getHNOString("NAME"));
+            mLazy = lazy;
+        }
+
+        StagedRecord *stage(ESM::ESMReader &esm, const std::string &id) {
+            if (mLazy) {
+                StagedRecord *staged = new StagedLazyRecord<Store<T> >(*this,
+                    Misc::StringUtils::lowerCase(id), esm, esm.getContext());
+                esm.skipRecord();
+                return staged;
+            }
+
+            StagedStoreRecord<Store<T>, T> *staged = new StagedStoreRecord<Store<T>, T>(*this);
+            staged->mRecord.mId = Misc::StringUtils::lowerCase(id);
+            staged->mRecord.load(esm);
+            return staged;
+        }
+
+        void merge(const T &record) {
+            T &current = getStatic(record.mId);
+            mLazyRecords.erase(&current);
+            current = record;
+        }
+
+        void mergeLazy(const std::string &id, ESM::ESMReader &esm, const ESM::ESM_Context &context) {
+            T &record = getStatic(id);
+            record = T();
+            record.mId = id;
+
+            LazyRecord &lazy = mLazyRecords[&record];
+            lazy.mReader = &esm;
+            lazy.mContext = context;
+        }
+
+        void writeCache(ESM::ESMWriter &writer, int type) const {
+            decodeAll();
+
+            ESM::NAME name;
+            name.val = type;
+
+            typename Static::const_iterator it = mStatic.begin();
+            for (; it != mStatic.end(); ++it) {
+                writer.startRecord(name.toString());
+                writer.writeHNOCString("NAME", it->second.mId);
+                it->second.save(writer);
+                writer.endRecord(name.toString());
+            }
         }
 
         void setUp() {
@@ -200,7 +461,23 @@ namespace MWWorld
             }
         }
 
+        void setUpAtoms(AtomTable &atoms) {
+            mAtoms = &atoms;
+            mByAtom.clear();
+
+            // Static records shadow dynamic ones, as in search()
+            typename Dynamic::const_iterator dit = mDynamic.begin();
+            for (; dit != mDynamic.end(); ++dit) {
+                setAtom(atoms.intern(dit->first), &dit->second);
+            }
+            typename Static::const_iterator it = mStatic.begin();
+            for (; it != mStatic.end(); ++it) {
+                setAtom(atoms.intern(it->first), &it->second);
+            }
+        }
+
         iterator begin() const {
+            decodeAll();
             return mShared.begin();
         }
 
@@ -226,7 +503,15 @@ namespace MWWorld
                 mDynamic.insert(std::pair<std::string, T>(id, item));
             T *ptr = &result.first->second;
             if (result.second) {
+                mDynamicIndex.insert(result.first->first, ptr);
                 mShared.push_back(ptr);
+
+                if (mAtoms != 0) {
+                    Atom atom = mAtoms->intern(id);
+                    if (search(atom) == 0) {
+                        setAtom(atom, ptr);
+                    }
+                }
             } else {
                 *ptr = item;
             }
@@ -239,8 +524,14 @@ namespace MWWorld
                 mStatic.insert(std::pair<std::string, T>(id, item));
             T *ptr = &result.first->second;
             if (result.second) {
+                mStaticIndex.insert(result.first->first, ptr);
                 mShared.push_back(ptr);
+
+                if (mAtoms != 0) {
+                    setAtom(mAtoms->intern(id), ptr);
+                }
             } else {
+                mLazyRecords.erase(ptr);
                 *ptr = item;
             }
             return ptr;
@@ -265,7 +556,16 @@ namespace MWWorld
                     }
                     ++sharedIter;
                 }
+                mStaticIndex.erase(it->first);
+                mLazyRecords.erase(&it->second);
                 mStatic.erase(it);
+
+                if (mAtoms != 0) {
+                    Atom atom = mAtoms->search(item.mId);
+                    if (atom != 0 && atom < mByAtom.size()) {
+                        mByAtom[atom] = mDynamicIndex.search(item.mId);
+                    }
+                }
             }
 
             return true;
@@ -277,7 +577,9 @@ namespace MWWorld
             if (it == mDynamic.end()) {
                 return false;
             }
+            mDynamicIndex.erase(it->first);
             mDynamic.erase(it);
+            resetAtom(key);
 
             // have to reinit the whole shared part
             mShared.erase(mShared.begin() + mStatic.size(), mShared.end());
@@ -300,18 +602,95 @@ namespace MWWorld
         if (it == mStatic.end()) {
             it = mStatic.insert( std::make_pair( idLower, ESM::Dialogue() ) ).first;
             it->second.mId = id; // don't smash case here, as this line is printed... I think
+            mStaticIndex.insert(it->first, &it->second);
         }
 
         //I am not sure is it need to load the dialog from a plugin if it was already loaded from prevois plugins
         it->second.load(esm);
     }
 
+    template <>
+    inline StagedRecord *Store<ESM::Dialogue>::stage(ESM::ESMReader &esm, const std::string &id) {
+        StagedStoreRecord<Store<ESM::Dialogue>, ESM::Dialogue> *staged =
+            new StagedStoreRecord<Store<ESM::Dialogue>, ESM::Dialogue>(*this);
+        staged->mRecord.mId = id;
+        staged->mRecord.load(esm);
+        return staged;
+    }
+
+    template <>
+    inline void Store<ESM::Dialogue>::merge(const ESM::Dialogue &record) {
+        std::string idLower = Misc::StringUtils::lowerCase(record.mId);
+
+        std::map<std::string, ESM::Dialogue>::iterator it = mStatic.find(idLower);
+        if (it == mStatic.end()) {
+            it = mStatic.insert(std::make_pair(idLower, record)).first;
+            mStaticIndex.insert(it->first, &it->second);
+        } else {
+            // Dialogue::load() only reads the type, keep the existing id and infos
+            it->second.mType = record.mType;
+        }
+    }
+
+    template <>
+    inline void Store<ESM::Dialogue>::writeCache(ESM::ESMWriter &writer, int type) const {
+        // Keep the infos right behind their dialogue, as in a content file
+        Static::const_iterator it = mStatic.begin();
+        for (; it != mStatic.end(); ++it) {
+            writer.startRecord("DIAL");
+            writer.writeHNCString("NAME", it->second.mId);
+            it->second.save(writer);
+            writer.endRecord("DIAL");
+
+            std::vector<ESM::DialInfo>::const_iterator info = it->second.mInfo.begin();
+            for (; info != it->second.mInfo.end(); ++info) {
+                writer.startRecord("INFO");
+                writer.writeHNCString("INAM", info->mId);
+                info->save(writer);
+                writer.endRecord("INFO");
+            }
+        }
+    }
+
+    /// Read the id of a script, which is part of its header, and skip the rest
+    inline std::string skipScript(ESM::ESMReader &esm) {
+        char header[52];
+        esm.getHNExact(header, sizeof(header), "SCHD");
+        esm.skipRecord();
+
+        ESM::NAME32 name;
+        std::copy(header, header + sizeof(name.name), name.name);
+        return Misc::StringUtils::lowerCase(name.toString());
+    }
+
     template <>
     inline void Store<ESM::Script>::load(ESM::ESMReader &esm, const std::string &id) {
+        if (mLazy) {
+            // The body is read again from the start of the header
+            ESM::ESM_Context context = esm.getContext();
+            mergeLazy(skipScript(esm), esm, context);
+            return;
+        }
+
         ESM::Script scpt;
         scpt.load(esm);
         Misc::StringUtils::toLower(scpt.mId);
-        mStatic[scpt.mId] = scpt;
+        merge(scpt);
+    }
+
+    template <>
+    inline StagedRecord *Store<ESM::Script>::stage(ESM::ESMReader &esm, const std::string &id) {
+        if (mLazy) {
+            ESM::ESM_Context context = esm.getContext();
+            std::string name = skipScript(esm);
+            return new StagedLazyRecord<Store<ESM::Script> >(*this, name, esm, context);
+        }
+
+        StagedStoreRecord<Store<ESM::Script>, ESM::Script> *staged =
+            new StagedStoreRecord<Store<ESM::Script>, ESM::Script>(*this);
+        staged->mRecord.load(esm);
+        Misc::StringUtils::toLower(staged->mRecord.mId);
+        return staged;
     }
 
     template <>
@@ -319,7 +698,16 @@ namespace MWWorld
         ESM::StartScript s;
         s.load(esm);
         s.mId = Misc::StringUtils::toLower(s.mScript);
-        mStatic[s.mId] = s;
+        getStatic(s.mId) = s;
+    }
+
+    template <>
+    inline StagedRecord *Store<ESM::StartScript>::stage(ESM::ESMReader &esm, const std::string &id) {
+        StagedStoreRecord<Store<ESM::StartScript>, ESM::StartScript> *staged =
+            new StagedStoreRecord<Store<ESM::StartScript>, ESM::StartScript>(*this);
+        staged->mRecord.load(esm);
+        staged->mRecord.mId = Misc::StringUtils::toLower(staged->mRecord.mScript);
+        return staged;
     }
 
     template <>
@@ -338,6 +726,10 @@ namespace MWWorld
             ltexl.reserve(128);
         }
 
+        void clear() {
+            mStatic.assign(1, LandTextureList());
+        }
+
         typedef std::vector<ESM::LandTexture>::const_iterator iterator;
 
         const ESM::LandTexture *search(size_t index, size_t plugin) const {
@@ -372,6 +764,57 @@ namespace MWWorld
             lt.load(esm);
             lt.mId = id;
 
+            merge(lt, plugin);
+        }
+
+        void load(ESM::ESMReader &esm, const std::string &id) {
+            load(esm, id, esm.getIndex());
+        }
+
+        struct StagedLandTexture
+        {
+            ESM::LandTexture mTexture;
+            size_t mPlugin;
+        };
+
+        StagedRecord *stage(ESM::ESMReader &esm, const std::string &id) {
+            StagedStoreRecord<Store<ESM::LandTexture>, StagedLandTexture> *staged =
+                new StagedStoreRecord<Store<ESM::LandTexture>, StagedLandTexture>(*this);
+            staged->mRecord.mTexture.load(esm);
+            staged->mRecord.mTexture.mId = id;
+            staged->mRecord.mPlugin = esm.getIndex();
+            return staged;
+        }
+
+        void merge(const StagedLandTexture &staged) {
+            merge(staged.mTexture, staged.mPlugin);
+        }
+
+        void writeCache(ESM::ESMWriter &writer, int type) const {
+            for (size_t plugin = 0; plugin < mStatic.size(); ++plugin) {
+                const LandTextureList &ltexl = mStatic[plugin];
+                for (size_t i = 0; i < ltexl.size(); ++i) {
+                    // Skip the gaps left by resizing the list
+                    if (ltexl[i].mIndex != static_cast<int>(i))
+                        continue;
+
+                    writer.startRecord("LTEX");
+                    writer.writeHNCString("NAME", ltexl[i].mId);
+                    writer.writeHNT("PLGN", static_cast<int>(plugin));
+                    ltexl[i].save(writer);
+                    writer.endRecord("LTEX");
+                }
+            }
+        }
+
+        void readCache(ESM::ESMReader &esm) {
+            std::string id = esm.getHNString("NAME");
+            int plugin;
+            esm.getHNT(plugin, "PLGN");
+            load(esm, id, plugin);
+        }
+
+        void merge(const ESM::LandTexture &lt, size_t plugin) {
             // Make sure we have room for the structure
             if (plugin >= mStatic.size()) {
                 mStatic.resize(plugin+1);
@@ -384,10 +827,6 @@ namespace MWWorld
             ltexl[lt.mIndex] = lt;
         }
 
-        void load(ESM::ESMReader &esm, const std::string &id) {
-            load(esm, id, esm.getIndex());
-        }
-
         iterator begin(size_t plugin) const {
             assert(plugin < mStatic.size());
             return mStatic[plugin].begin();
@@ -427,6 +866,15 @@ namespace MWWorld
 
         }
 
+        void clear() {
+            for (std::vector<ESM::Land *>::const_iterator it =
+                             mStatic.begin(); it != mStatic.end(); ++it)
+            {
+                delete *it;
+            }
+            mStatic.clear();
+        }
+
         size_t getSize() const {
             return mStatic.size();
         }
@@ -466,6 +914,41 @@ namespace MWWorld
             ESM::Land *ptr = new ESM::Land();
             ptr->load(esm);
 
+            merge(ptr);
+        }
+
+        class StagedLand : public StagedRecord
+        {
+            Store<ESM::Land> &mStore;
+            ESM::Land *mLand;
+
+        public:
+            StagedLand(Store<ESM::Land> &store, ESM::Land *land)
+              : mStore(store), mLand(land)
+            {}
+
+            virtual ~StagedLand() {
+                delete mLand;
+            }
+
+            virtual void merge() {
+                mStore.merge(mLand);
+                mLand = 0;
+            }
+        };
+
+        StagedRecord *stage(ESM::ESMReader &esm, const std::string &id) {
+            ESM::Land *ptr = new ESM::Land();
+            StagedLand *staged = new StagedLand(*this, ptr);
+            ptr->load(esm);
+            return staged;
+        }
+
+        void writeCache(ESM::ESMWriter &writer, int type) const;
+        void readCache(ESM::ESMReader &esm);
+
+        /// Takes ownership of \a ptr.
+        void merge(ESM::Land *ptr) {
             // Same area defined in multiple plugins? -> last plugin wins
             // Can't use search() because we aren't sorted yet - is there any other way to speed this up?
             for (std::vector<ESM::Land*>::iterator it = mStatic.begin(); it != mStatic.end(); ++it)
@@ -528,6 +1011,18 @@ namespace MWWorld
             return search(cell.mName);
         }
 
+    public:
+        struct StagedCell
+        {
+            ESM::Cell mCell;
+
+            // Reference data for each entry in mCell.mMovedRefs
+            std::vector<ESM::CellRef> mMovedRefData;
+        };
+
+    private:
+        static void decode(ESM::ESMReader &esm, const std::string &id, StagedCell &staged);
+
     public:
         ESMStore *mEsmStore;
 
@@ -536,6 +1031,15 @@ namespace MWWorld
         Store<ESM::Cell>()
         {}
 
+        void clear() {
+            mInt.clear();
+            mExt.clear();
+            mSharedInt.clear();
+            mSharedExt.clear();
+            mDynamicInt.clear();
+            mDynamicExt.clear();
+        }
+
         const ESM::Cell *search(const std::string &id) const {
             ESM::Cell cell;
             cell.mName = Misc::StringUtils::lowerCase(id);
@@ -640,6 +1144,13 @@ namespace MWWorld
         //  this method.
         void load(ESM::ESMReader &esm, const std::string &id);
 
+        StagedRecord *stage(ESM::ESMReader &esm, const std::string &id);
+
+        void merge(StagedCell &staged);
+
+        void writeCache(ESM::ESMWriter &writer, int type) const;
+        void readCache(ESM::ESMReader &esm);
+
         iterator intBegin() const {
             return iterator(mSharedInt.begin());
         }
@@ -819,11 +1330,36 @@ namespace MWWorld
 
     public:
 
+        void clear() {
+            mStatic.clear();
+            mIntBegin = mIntEnd = mExtBegin = mExtEnd = mStatic.end();
+        }
+
         void load(ESM::ESMReader &esm, const std::string &id) {
             mStatic.push_back(ESM::Pathgrid());
             mStatic.back().load(esm);
         }
 
+        StagedRecord *stage(ESM::ESMReader &esm, const std::string &id) {
+            StagedStoreRecord<Store<ESM::Pathgrid>, ESM::Pathgrid> *staged =
+                new StagedStoreRecord<Store<ESM::Pathgrid>, ESM::Pathgrid>(*this);
+            staged->mRecord.load(esm);
+            return staged;
+        }
+
+        void merge(const ESM::Pathgrid &pathgrid) {
+            mStatic.push_back(pathgrid);
+        }
+
+        void writeCache(ESM::ESMWriter &writer, int type) const {
+            std::vector<ESM::Pathgrid>::const_iterator it = mStatic.begin();
+            for (; it != mStatic.end(); ++it) {
+                writer.startRecord("PGRD");
+                it->save(writer);
+                writer.endRecord("PGRD");
+            }
+        }
+
         size_t getSize() const {
             return mStatic.size();
         }
@@ -949,6 +1485,10 @@ namespace MWWorld
             mStatic.reserve(size);
         }
 
+        void clear() {
+            mStatic.clear();
+        }
+
         iterator begin() const {
             return mStatic.begin();
         }
@@ -963,6 +1503,29 @@ namespace MWWorld
             mStatic.back().load(esm);
         }
 
+        StagedRecord *stage(ESM::ESMReader &esm) {
+            StagedStoreRecord<IndexedStore<T>, T> *staged =
+                new StagedStoreRecord<IndexedStore<T>, T>(*this);
+            staged->mRecord.load(esm);
+            return staged;
+        }
+
+        void merge(const T &record) {
+            mStatic.push_back(record);
+        }
+
+        void writeCache(ESM::ESMWriter &writer) const {
+            ESM::NAME name;
+            name.val = T::sRecordId;
+
+            typename std::vector<T>::const_iterator it = mStatic.begin();
+            for (; it != mStatic.end(); ++it) {
+                writer.startRecord(name.toString());
+                it->save(writer);
+                writer.endRecord(name.toString());
+            }
+        }
+
         int getSize() const {
             return mStatic.size();
         }
@@ -14,6 +14,7 @@
 #include <components/bsa/bsa_archive.hpp>
 #include <components/files/collections.hpp>
 #include <components/compiler/locals.hpp>
+#include <components/settings/settings.hpp>
 
 #include <boost/math/special_functions/sign.hpp>
 
@@ -74,23 +75,6 @@ namespace
         }
     }
 */
-    template<typename T>
-    MWWorld::LiveCellRef<T> *searchViaHandle (const std::string& handle,
-        MWWorld::CellRefList<T>& refList)
-    {
-        typedef typename MWWorld::CellRefList<T>::List::iterator iterator;
-
-        for (iterator iter (refList.mList.begin()); iter!=refList.mList.end(); ++iter)
-        {
-            if (iter->mData.getCount() > 0 && iter->mData.getBaseNode()){
-            if (iter->mData.getHandle()==handle)
-            {
-                return &*iter;
-            }
-            }
-        }
-        return 0;
-    }
 }
 
 namespace MWWorld
@@ -122,57 +106,17 @@ namespace MWWorld
             }
         }
 
+        void finish()
+        {
+            for (LoadersContainer::iterator it = mLoaders.begin(); it != mLoaders.end(); ++it)
+                it->second->finish();
+        }
+
         private:
           typedef std::tr1::unordered_map<std::string, ContentLoader*> LoadersContainer;
           LoadersContainer mLoaders;
     };
 
-    Ptr World::getPtrViaHandle (const std::string& handle, Ptr::CellStore& cell)
-    {
-        if (MWWorld::LiveCellRef<ESM::Activator> *ref =
-            searchViaHandle (handle, cell.mActivators))
-            return Ptr (ref, &cell);
-        if (MWWorld::LiveCellRef<ESM::Potion> *ref = searchViaHandle (handle, cell.mPotions))
-            return Ptr (ref, &cell);
-        if (MWWorld::LiveCellRef<ESM::Apparatus> *ref = searchViaHandle (handle, cell.mAppas))
-            return Ptr (ref, &cell);
-        if (MWWorld::LiveCellRef<ESM::Armor> *ref = searchViaHandle (handle, cell.mArmors))
-            return Ptr (ref, &cell);
-        if (MWWorld::LiveCellRef<ESM::Book> *ref = searchViaHandle (handle, cell.mBooks))
-            return Ptr (ref, &cell);
-        if (MWWorld::LiveCellRef<ESM::Clothing> *ref = searchViaHandle (handle, cell.mClothes))
-            return Ptr (ref, &cell);
-        if (MWWorld::LiveCellRef<ESM::Container> *ref =
-            searchViaHandle (handle, cell.mContainers))
-            return Ptr (ref, &cell);
-        if (MWWorld::LiveCellRef<ESM::Creature> *ref =
-            searchViaHandle (handle, cell.mCreatures))
-            return Ptr (ref, &cell);
-        if (MWWorld::LiveCellRef<ESM::Door> *ref = searchViaHandle (handle, cell.mDoors))
-            return Ptr (ref, &cell);
-        if (MWWorld::LiveCellRef<ESM::Ingredient> *ref =
-            searchViaHandle (handle, cell.mIngreds))
-            return Ptr (ref, &cell);
-        if (MWWorld::LiveCellRef<ESM::Light> *ref = searchViaHandle (handle, cell.mLights))
-            return Ptr (ref, &cell);
-        if (MWWorld::LiveCellRef<ESM::Lockpick> *ref = searchViaHandle (handle, cell.mLockpicks))
-            return Ptr (ref, &cell);
-        if (MWWorld::LiveCellRef<ESM::Miscellaneous> *ref = searchViaHandle (handle, cell.mMiscItems))
-            return Ptr (ref, &cell);
-        if (MWWorld::LiveCellRef<ESM::NPC> *ref = searchViaHandle (handle, cell.mNpcs))
-            return Ptr (ref, &cell);
-        if (MWWorld::LiveCellRef<ESM::Probe> *ref = searchViaHandle (handle, cell.mProbes))
-            return Ptr (ref, &cell);
-        if (MWWorld::LiveCellRef<ESM::Repair> *ref = searchViaHandle (handle, cell.mRepairs))
-            return Ptr (ref, &cell);
-        if (MWWorld::LiveCellRef<ESM::Static> *ref = searchViaHandle (handle, cell.mStatics))
-            return Ptr (ref, &cell);
-        if (MWWorld::LiveCellRef<ESM::Weapon> *ref = searchViaHandle (handle, cell.mWeapons))
-            return Ptr (ref, &cell);
-        return Ptr();
-    }
-
-
     int World::getDaysPerMonth (int month) const
     {
         switch (month)
@@ -210,6 +154,7 @@ namespace MWWorld
 
     World::World (OEngine::Render::OgreRenderer& renderer,
         const Files::Collections& fileCollections,
+        const Bsa::VFS& vfs,
         const std::vector<std::string>& contentFiles,
         const boost::filesystem::path& resDir, const boost::filesystem::path& cacheDir,
         ToUTF8::Utf8Encoder* encoder, const std::map<std::string,std::string>& fallbackMap, int mActivationDistanceOverride)
@@ -233,8 +178,15 @@ namespace MWWorld
         Loading::Listener* listener = MWBase::Environment::get().getWindowManager()->getLoadingScreen();
         listener->loadingOn();
 
+        mStore.setLazyLoading(Settings::Manager::getBool("lazy records", "Content"));
+
         GameContentLoader gameContentLoader(*listener);
-        EsmLoader esmLoader(mStore, mEsm, encoder, *listener);
+        std::string recordCache;
+        if (Settings::Manager::getBool("record cache", "Content"))
+            recordCache = (cacheDir / "records.cache").string();
+
+        EsmLoader esmLoader(mStore, mEsm, encoder, *listener,
+            Settings::Manager::getInt("loading threads", "Content"), recordCache);
         OmwLoader omwLoader(*listener);
 
         gameContentLoader.addLoader(".esm", &esmLoader);
@@ -253,9 +205,11 @@ namespace MWWorld
         mStore.setUp();
         mStore.movePlayerRecord();
 
+        mCells.indexRefs();
+
         mGlobalVariables = new Globals (mStore);
 
-        mWorldScene = new Scene(*mRendering, mPhysics);
+        mWorldScene = new Scene(*mRendering, mPhysics, vfs);
     }
 
     void World::startNewGame()
@@ -504,22 +458,24 @@ namespace MWWorld
         if (!ptr.isEmpty())
             return ptr;
 
-        std::string lowerCaseName = Misc::StringUtils::lowerCase(name);
+        // Only look the name up once, references are matched by atom
+        Atom atom = mStore.getAtom (name);
 
         // active cells
         for (Scene::CellStoreCollection::const_iterator iter (mWorldScene->getActiveCells().begin());
             iter!=mWorldScene->getActiveCells().end(); ++iter)
         {
             Ptr::CellStore* cellstore = *iter;
-            Ptr ptr = mCells.getPtr (lowerCaseName, *cellstore, true);
+            Ptr ptr = atom ? mCells.getPtr (atom, *cellstore, true)
+                : mCells.getPtr (name, *cellstore, true);
 
             if (!ptr.isEmpty())
                 return ptr;
         }
 
-        if (!activeOnly)
+        if (!activeOnly && atom)
         {
-            ret = mCells.getPtr (lowerCaseName);
+            ret = mCells.getPtr (atom);
         }
         return ret;
     }
@@ -544,17 +500,8 @@ namespace MWWorld
     {
         if (mPlayer->getPlayer().getRefData().getHandle()==handle)
             return mPlayer->getPlayer();
-        for (Scene::CellStoreCollection::const_iterator iter (mWorldScene->getActiveCells().begin());
-            iter!=mWorldScene->getActiveCells().end(); ++iter)
-        {
-            Ptr::CellStore* cellstore = *iter;
-            Ptr ptr = getPtrViaHandle (handle, *cellstore);
 
-            if (!ptr.isEmpty())
-                return ptr;
-        }
-
-        return MWWorld::Ptr();
+        return mWorldScene->searchPtrViaHandle (handle);
     }
 
     void World::addContainerScripts(const Ptr& reference, Ptr::CellStore * cell)
@@ -902,7 +849,7 @@ namespace MWWorld
                     MWWorld::Ptr copy =
                         MWWorld::Class::get(ptr).copyToCell(ptr, newCell, pos);
 
-                    mRendering->updateObjectCell(ptr, copy);
+                    mWorldScene->updateObjectCell(ptr, copy);
 
                     MWBase::MechanicsManager *mechMgr = MWBase::Environment::get().getMechanicsManager();
                     mechMgr->updateCell(ptr, copy);
@@ -953,7 +900,8 @@ namespace MWWorld
         ptr.getCellRef().mScale = scale;
         MWWorld::Class::get(ptr).adjustScale(ptr,scale);
 
-        if(ptr.getRefData().getBaseNode() == 0)
+        // Objects of cached cells are inserted anew when their scale changed
+        if(ptr.getRefData().getBaseNode() == 0 || !mWorldScene->isCellActive(*ptr.getCell()))
             return;
         mRendering->scaleObject(ptr, Vector3(scale,scale,scale));
         mPhysics->scaleObject(ptr);
@@ -1561,6 +1509,9 @@ namespace MWWorld
         MWWorld::Ptr dropped =
             MWWorld::Class::get(object).copyToCell(object, cell, pos);
 
+        // The copy gets its own scene node, if any
+        dropped.getRefData().setBaseNode(0);
+
         if (mWorldScene->isCellActive(cell)) {
             if (dropped.getRefData().isEnabled()) {
                 mWorldScene->addObjectToScene(dropped);
@@ -2044,6 +1995,7 @@ namespace MWWorld
                 contentLoader.load(col.getPath(*it), idx);
             }
         }
+        contentLoader.finish();
     }
 
     bool World::startSpellCast(const Ptr &actor)
@@ -31,6 +31,11 @@ namespace Files
     class Collections;
 }
 
+namespace Bsa
+{
+    class VFS;
+}
+
 namespace Render
 {
     class OgreRenderer;
@@ -78,8 +83,6 @@ namespace MWWorld
             World (const World&);
             World& operator= (const World&);
 
-            Ptr getPtrViaHandle (const std::string& handle, Ptr::CellStore& cellStore);
-
             int mActivationDistanceOverride;
             std::string mFacedHandle;
             float mFacedDistance;
@@ -162,6 +165,7 @@ namespace MWWorld
 
             World (OEngine::Render::OgreRenderer& renderer,
                 const Files::Collections& fileCollections,
+                const Bsa::VFS& vfs,
                 const std::vector<std::string>& contentFiles,
                 const boost::filesystem::path& resDir, const boost::filesystem::path& cacheDir,
                 ToUTF8::Utf8Encoder* encoder, const std::map<std::string,std::string>& fallbackMap, int mActivationDistanceOverride);
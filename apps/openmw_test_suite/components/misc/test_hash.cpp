@@ -0,0 +1,42 @@
+#include <gtest/gtest.h>
+#include "components/misc/hash.hpp"
+
+struct HashTest : public ::testing::Test
+{
+  protected:
+    virtual void SetUp()
+    {
+    }
+
+    virtual void TearDown()
+    {
+    }
+};
+
+TEST_F(HashTest, empty_input_is_the_offset_basis)
+{
+  ASSERT_EQ(0xcbf29ce484222325ULL, Misc::Hash().get());
+}
+
+TEST_F(HashTest, matches_fnv1a_test_vectors)
+{
+  Misc::Hash a;
+  a.add("a");
+  ASSERT_EQ(0xaf63dc4c8601ec8cULL, a.get());
+
+  Misc::Hash foobar;
+  foobar.add("foobar");
+  ASSERT_EQ(0x85944171f73967e8ULL, foobar.get());
+}
+
+TEST_F(HashTest, bytes_and_strings_agree)
+{
+  Misc::Hash bytes;
+  bytes.add('f');
+  bytes.add('o');
+  bytes.add('o');
+
+  Misc::Hash str;
+  str.add("foo");
+  ASSERT_EQ(str.get(), bytes.get());
+}
@@ -0,0 +1,189 @@
+#include <gtest/gtest.h>
+#include "components/nif/niffile.hpp"
+
+struct NIFStreamTest : public ::testing::Test
+{
+  protected:
+    virtual void SetUp()
+    {
+    }
+
+    virtual void TearDown()
+    {
+    }
+
+    void putLe16(uint16_t value)
+    {
+      mData.push_back(value & 0xff);
+      mData.push_back(value >> 8);
+    }
+
+    void putLe32(uint32_t value)
+    {
+      for(int i = 0;i < 4;i++)
+        mData.push_back((value >> (i*8)) & 0xff);
+    }
+
+    void putFloat(float value)
+    {
+      union {
+        float f;
+        uint32_t i;
+      } u;
+      u.f = value;
+      putLe32(u.i);
+    }
+
+    void putFloats(size_t count)
+    {
+      for(size_t i = 0;i < count;i++)
+        putFloat(i*1.5f - 4.0f);
+    }
+
+    /// A new stream over the bytes put so far
+    Ogre::DataStreamPtr open()
+    {
+      return Ogre::DataStreamPtr(new Ogre::MemoryDataStream(&mData[0], mData.size()));
+    }
+
+    std::vector<uint8_t> mData;
+};
+
+TEST_F(NIFStreamTest, reads_little_endian_fields)
+{
+  putLe16(0xfffe);
+  putLe32(0x12345678);
+  putFloat(0.25f);
+  putLe32(5);
+  mData.push_back('a');
+  mData.push_back('b');
+  mData.push_back(0);
+  mData.push_back('c');
+  mData.push_back('d');
+
+  Nif::NIFStream nif(0, open());
+  ASSERT_EQ(-2, nif.getShort());
+  ASSERT_EQ(0x12345678, nif.getInt());
+  ASSERT_EQ(0.25f, nif.getFloat());
+  ASSERT_EQ("ab", nif.getString());
+}
+
+TEST_F(NIFStreamTest, starts_at_the_stream_position)
+{
+  putLe32(1);
+  putLe32(2);
+
+  Ogre::DataStreamPtr stream = open();
+  stream->skip(4);
+
+  Nif::NIFStream nif(0, stream);
+  ASSERT_EQ(2, nif.getInt());
+}
+
+TEST_F(NIFStreamTest, getFloats_matches_getFloat)
+{
+  putFloats(7);
+
+  Nif::NIFStream bulk(0, open());
+  Nif::NIFStream single(0, open());
+
+  std::vector<float> floats;
+  bulk.getFloats(floats, 7);
+  ASSERT_EQ(7u, floats.size());
+  for(size_t i = 0;i < floats.size();i++)
+    ASSERT_EQ(single.getFloat(), floats[i]);
+}
+
+TEST_F(NIFStreamTest, getVector3s_matches_getVector3)
+{
+  putFloats(9);
+
+  Nif::NIFStream bulk(0, open());
+  Nif::NIFStream single(0, open());
+
+  std::vector<Ogre::Vector3> vectors;
+  bulk.getVector3s(vectors, 3);
+  ASSERT_EQ(3u, vectors.size());
+  for(size_t i = 0;i < vectors.size();i++)
+    ASSERT_EQ(single.getVector3(), vectors[i]);
+}
+
+TEST_F(NIFStreamTest, getQuaternions_matches_getQuaternion)
+{
+  putFloats(8);
+
+  Nif::NIFStream bulk(0, open());
+  Nif::NIFStream single(0, open());
+
+  std::vector<Ogre::Quaternion> quats;
+  bulk.getQuaternions(quats, 2);
+  ASSERT_EQ(2u, quats.size());
+  for(size_t i = 0;i < quats.size();i++)
+    ASSERT_EQ(single.getQuaternion(), quats[i]);
+}
+
+TEST_F(NIFStreamTest, getShorts_matches_getShort)
+{
+  putLe16(0);
+  putLe16(1);
+  putLe16(0x8000);
+  putLe16(0xffff);
+
+  Nif::NIFStream bulk(0, open());
+  Nif::NIFStream single(0, open());
+
+  std::vector<short> shorts;
+  bulk.getShorts(shorts, 4);
+  ASSERT_EQ(4u, shorts.size());
+  for(size_t i = 0;i < shorts.size();i++)
+    ASSERT_EQ(single.getShort(), shorts[i]);
+  ASSERT_EQ(-1, shorts[3]);
+}
+
+TEST_F(NIFStreamTest, arrays_past_the_end_are_filled_with_zeros)
+{
+  putFloats(2);
+  putLe16(0x1234);
+
+  Nif::NIFStream nif(0, open());
+
+  std::vector<float> floats;
+  nif.getFloats(floats, 4);
+  ASSERT_EQ(4u, floats.size());
+  ASSERT_EQ(-4.0f, floats[0]);
+  ASSERT_EQ(-2.5f, floats[1]);
+  ASSERT_EQ(0.0f, floats[2]);
+  ASSERT_EQ(0.0f, floats[3]);
+
+  // The partial float was skipped with the rest of the file
+  std::vector<short> shorts;
+  nif.getShorts(shorts, 2);
+  ASSERT_EQ(2u, shorts.size());
+  ASSERT_EQ(0, shorts[0]);
+  ASSERT_EQ(0, shorts[1]);
+}
+
+TEST_F(NIFStreamTest, fields_past_the_end_are_zero)
+{
+  putLe16(7);
+  putLe16(8);
+  mData.push_back(9);
+
+  Nif::NIFStream nif(0, open());
+  ASSERT_EQ(7, nif.getShort());
+
+  // Too short for an int: the rest of the file is skipped
+  ASSERT_EQ(0, nif.getInt());
+  ASSERT_EQ(0, nif.getChar());
+  ASSERT_EQ(0.0f, nif.getFloat());
+}
+
+TEST_F(NIFStreamTest, string_past_the_end_throws)
+{
+  putLe32(8);
+  mData.push_back('a');
+  mData.push_back('b');
+
+  Nif::NIFStream nif(0, open());
+  ASSERT_THROW(nif.getString(), std::runtime_error);
+}
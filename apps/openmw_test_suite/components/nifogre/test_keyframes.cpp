@@ -0,0 +1,191 @@
+#include <gtest/gtest.h>
+#include "components/nif/data.hpp"
+#include "components/nifogre/keyframes.hpp"
+
+#include <cmath>
+
+struct KeyframeTrackTest : public ::testing::Test
+{
+  protected:
+    virtual void SetUp()
+    {
+      mSeed = 12345;
+    }
+
+    virtual void TearDown()
+    {
+    }
+
+    /// Deterministic random number in [min, max)
+    float random(float min, float max)
+    {
+      mSeed = mSeed*1103515245 + 12345;
+      return min + (max-min) * ((mSeed >> 8) & 0xffff) / 65536.0f;
+    }
+
+    template<typename T>
+    static void addKey(std::vector<Nif::KeyT<T> > &keys, float time, const T &value)
+    {
+      Nif::KeyT<T> key;
+      key.mTime = time;
+      key.mValue = value;
+      keys.push_back(key);
+    }
+
+    /// Linear interpolation over the full keys, as KeyframeController::Value does it
+    template<typename T>
+    static T interpolate(const std::vector<Nif::KeyT<T> > &keys, float time)
+    {
+      if(time <= keys.front().mTime)
+        return keys.front().mValue;
+
+      for(size_t i = 1;i < keys.size();i++)
+      {
+        if(keys[i].mTime < time)
+          continue;
+
+        float a = (time-keys[i-1].mTime) / (keys[i].mTime-keys[i-1].mTime);
+        return keys[i-1].mValue + ((keys[i].mValue - keys[i-1].mValue)*a);
+      }
+      return keys.back().mValue;
+    }
+
+    static Ogre::Quaternion interpolate(const std::vector<Nif::QuaternionKey> &keys, float time)
+    {
+      if(time <= keys.front().mTime)
+        return keys.front().mValue;
+
+      for(size_t i = 1;i < keys.size();i++)
+      {
+        if(keys[i].mTime < time)
+          continue;
+
+        float a = (time-keys[i-1].mTime) / (keys[i].mTime-keys[i-1].mTime);
+        return Ogre::Quaternion::nlerp(a, keys[i-1].mValue, keys[i].mValue);
+      }
+      return keys.back().mValue;
+    }
+
+    /// Tracks are shared by file name and record index, so each test uses its own name
+    NifOgre::KeyframeTrackPtr getTrack(const std::string &name)
+    {
+      mData.recIndex = 0;
+      return NifOgre::KeyframeTrack::get(name, &mData);
+    }
+
+    uint32_t mSeed;
+    Nif::NiKeyframeData mData;
+};
+
+TEST_F(KeyframeTrackTest, matches_full_keys_on_random_tracks)
+{
+  float time = random(-1.0f, 1.0f);
+  for(size_t i = 0;i < 200;i++)
+  {
+    Ogre::Quaternion rotation(random(-1.0f, 1.0f), random(-1.0f, 1.0f), random(-1.0f, 1.0f), random(-1.0f, 1.0f));
+    rotation.normalise();
+    addKey(mData.mRotations.mKeys, time, rotation);
+    addKey(mData.mTranslations.mKeys, time, Ogre::Vector3(random(-10.0f, 10.0f), random(-10.0f, 10.0f), random(-10.0f, 10.0f)));
+    addKey(mData.mScales.mKeys, time, random(0.5f, 2.0f));
+    time += random(0.05f, 0.5f);
+  }
+
+  NifOgre::KeyframeTrackPtr track = getTrack("random.kf");
+  ASSERT_TRUE(track->hasRotations());
+  ASSERT_TRUE(track->hasTranslations());
+  ASSERT_TRUE(track->hasScales());
+
+  float start = mData.mRotations.mKeys.front().mTime - 1.0f;
+  float stop = mData.mRotations.mKeys.back().mTime + 1.0f;
+  for(size_t i = 0;i < 5000;i++)
+  {
+    float t = random(start, stop);
+
+    Ogre::Quaternion rotation = interpolate(mData.mRotations.mKeys, t);
+    rotation.normalise();
+    EXPECT_GT(std::abs(rotation.Dot(track->getRotation(t))), 1.0f - 1e-5f) << "at " << t;
+
+    Ogre::Vector3 translation = interpolate(mData.mTranslations.mKeys, t);
+    EXPECT_LT(translation.distance(track->getTranslation(t)), 1e-2f) << "at " << t;
+
+    EXPECT_NEAR(interpolate(mData.mScales.mKeys, t), track->getScale(t), 1e-3f) << "at " << t;
+  }
+}
+
+TEST_F(KeyframeTrackTest, key_times_are_rounded_per_key)
+{
+  // The long gap makes a tick much coarser than the short ones, which are
+  // not a whole number of ticks. Rounding the gaps would add up the errors.
+  addKey(mData.mScales.mKeys, 0.0f, 0.0f);
+  float time = 100.0f;
+  for(size_t i = 1;i < 2000;i++)
+  {
+    addKey(mData.mScales.mKeys, time, float(i));
+    time += 0.013f;
+  }
+
+  NifOgre::KeyframeTrackPtr track = getTrack("rounding.kf");
+  for(size_t i = 1;i < mData.mScales.mKeys.size();i++)
+    ASSERT_NEAR(float(i), track->getScale(mData.mScales.mKeys[i].mTime), 0.1f) << "key " << i;
+}
+
+TEST_F(KeyframeTrackTest, duplicate_key_times_jump)
+{
+  addKey(mData.mScales.mKeys, 0.0f, 0.0f);
+  addKey(mData.mScales.mKeys, 1.0f, 1.0f);
+  addKey(mData.mScales.mKeys, 1.0f, 5.0f);
+  addKey(mData.mScales.mKeys, 2.0f, 6.0f);
+
+  NifOgre::KeyframeTrackPtr track = getTrack("duplicates.kf");
+  ASSERT_NEAR(0.5f, track->getScale(0.5f), 1e-4f);
+  ASSERT_NEAR(5.5f, track->getScale(1.5f), 1e-4f);
+
+  // Either side of the jump, but nothing in between
+  float jump = track->getScale(1.0f);
+  ASSERT_TRUE(std::abs(jump - 1.0f) < 1e-4f || std::abs(jump - 5.0f) < 1e-4f) << jump;
+
+  const float times[] = { 0.999f, 1.001f, 1.999f };
+  for(size_t i = 0;i < sizeof(times)/sizeof(times[0]);i++)
+    ASSERT_NEAR(interpolate(mData.mScales.mKeys, times[i]), track->getScale(times[i]), 1e-3f);
+}
+
+TEST_F(KeyframeTrackTest, keys_all_at_one_time)
+{
+  addKey(mData.mScales.mKeys, 3.0f, 1.0f);
+  addKey(mData.mScales.mKeys, 3.0f, 2.0f);
+  addKey(mData.mScales.mKeys, 3.0f, 3.0f);
+
+  NifOgre::KeyframeTrackPtr track = getTrack("instant.kf");
+  ASSERT_EQ(1.0f, track->getScale(2.0f));
+  ASSERT_EQ(1.0f, track->getScale(3.0f));
+  ASSERT_EQ(3.0f, track->getScale(4.0f));
+}
+
+TEST_F(KeyframeTrackTest, holds_the_end_keys)
+{
+  addKey(mData.mTranslations.mKeys, 1.0f, Ogre::Vector3(1.0f, 2.0f, 3.0f));
+  addKey(mData.mTranslations.mKeys, 2.0f, Ogre::Vector3(4.0f, 5.0f, 6.0f));
+  addKey(mData.mScales.mKeys, 5.0f, 2.0f);
+
+  NifOgre::KeyframeTrackPtr track = getTrack("ends.kf");
+  ASSERT_FALSE(track->hasRotations());
+
+  ASSERT_EQ(Ogre::Vector3(1.0f, 2.0f, 3.0f), track->getTranslation(-10.0f));
+  ASSERT_TRUE(track->getTranslation(1.0f).positionEquals(Ogre::Vector3(1.0f, 2.0f, 3.0f), 1e-4f));
+  ASSERT_TRUE(track->getTranslation(2.0f).positionEquals(Ogre::Vector3(4.0f, 5.0f, 6.0f), 1e-4f));
+  ASSERT_EQ(Ogre::Vector3(4.0f, 5.0f, 6.0f), track->getTranslation(10.0f));
+
+  // A single key holds for all times
+  ASSERT_EQ(2.0f, track->getScale(0.0f));
+  ASSERT_EQ(2.0f, track->getScale(5.0f));
+  ASSERT_EQ(2.0f, track->getScale(10.0f));
+}
+
+TEST_F(KeyframeTrackTest, is_shared_per_record)
+{
+  addKey(mData.mScales.mKeys, 0.0f, 1.0f);
+
+  NifOgre::KeyframeTrackPtr track = getTrack("shared.kf");
+  ASSERT_EQ(track, getTrack("shared.kf"));
+  ASSERT_NE(track, getTrack("other.kf"));
+}
@@ -30,6 +30,7 @@
 #include <OgreArchiveFactory.h>
 #include <OgreArchiveManager.h>
 #include "bsa_file.hpp"
+#include "vfs.hpp"
 
 #include "../files/constrainedfiledatastream.hpp"
 
@@ -57,6 +58,14 @@ static std::string normalize_path(T1 begin, T2 end)
     return normalized;
 }
 
+/// Modification time of a file on disk, or 0 if it can't be read
+static time_t modifiedTime(const std::string& path)
+{
+    boost::system::error_code ec;
+    time_t time = boost::filesystem::last_write_time(path, ec);
+    return ec ? 0 : time;
+}
+
 /// An OGRE Archive wrapping a BSAFile archive
 class DirArchive: public Ogre::Archive
 {
@@ -146,7 +155,15 @@ public:
         return lookup_filename(filename) != mIndex.end ();
     }
 
-    time_t getModifiedTime(const String&) { return 0; }
+    time_t getModifiedTime(const String& filename)
+    {
+        index::const_iterator i = lookup_filename (filename);
+
+        if (i == mIndex.end ())
+            return 0;
+
+        return modifiedTime (i->second);
+    }
 
     FileInfoListPtr findFileInfo(const String& pattern, bool recursive = true,
                             bool dirs = false) const
@@ -231,7 +248,8 @@ public:
     return arc.exists(filename.c_str());
   }
 
-  time_t getModifiedTime(const String&) { return 0; }
+  // Files change with the archive they are in
+  time_t getModifiedTime(const String&) { return modifiedTime(mName); }
 
   // This is never called as far as I can see.
   StringVectorPtr list(bool recursive = true, bool dirs = false)
@@ -266,6 +284,15 @@ public:
     {
         std::string normalizedPattern = normalize_path(pattern.begin(), pattern.end());
         FileInfoListPtr ptr = FileInfoListPtr(new FileInfoList());
+
+        // Plain names are looked up directly
+        if(normalizedPattern.find('*') == std::string::npos)
+        {
+            if(const Bsa::BSAFile::FileStruct *entry = arc.search(pattern.c_str()))
+                ptr->push_back(fileInfo(*entry));
+            return ptr;
+        }
+
         const Bsa::BSAFile::FileList &filelist = arc.getList();
 
         for(Bsa::BSAFile::FileList::const_iterator iter = filelist.begin();iter != filelist.end();++iter)
@@ -273,23 +300,149 @@ public:
             std::string ent = normalize_path(iter->name, iter->name+std::strlen(iter->name));
             if(Ogre::StringUtil::match(ent, normalizedPattern) ||
                 (recursive && Ogre::StringUtil::match(ent, "*/"+normalizedPattern)))
-            {
-                std::string::size_type pt = ent.rfind('/');
-                if(pt == std::string::npos)
-                    pt = 0;
+                ptr->push_back(fileInfo(*iter));
+        }
 
-                FileInfo fi;
-                fi.archive = const_cast<BSAArchive*>(this);
-                fi.path = std::string(iter->name, pt);
-                fi.filename = std::string(iter->name + ((ent[pt]=='/') ? pt+1 : pt));
-                fi.compressedSize = fi.uncompressedSize = iter->fileSize;
+        return ptr;
+    }
 
-                ptr->push_back(fi);
-            }
+private:
+
+    FileInfo fileInfo(const Bsa::BSAFile::FileStruct &entry) const
+    {
+        std::string ent = normalize_path(entry.name, entry.name+std::strlen(entry.name));
+
+        std::string::size_type pt = ent.rfind('/');
+        if(pt == std::string::npos)
+            pt = 0;
+
+        FileInfo fi;
+        fi.archive = const_cast<BSAArchive*>(this);
+        fi.path = std::string(entry.name, pt);
+        fi.filename = std::string(entry.name + ((ent[pt]=='/') ? pt+1 : pt));
+        fi.compressedSize = fi.uncompressedSize = entry.fileSize;
+        return fi;
+    }
+};
+
+/// An OGRE Archive wrapping all data directories and BSA archives at once
+class VFSArchive : public Archive
+{
+    const Bsa::VFS& mVFS;
+
+    static bool hasWildcard(const std::string& pattern)
+    {
+        return pattern.find('*') != std::string::npos;
+    }
+
+    bool matches(const std::string& name, const std::string& pattern, bool recursive) const
+    {
+        return Ogre::StringUtil::match(name, pattern) ||
+            (recursive && Ogre::StringUtil::match(name, "*/"+pattern));
+    }
+
+public:
+    VFSArchive(const String& name, const Bsa::VFS& vfs)
+        : Archive(name, "VFS"), mVFS(vfs)
+    {}
+
+    bool isCaseSensitive() const { return false; }
+
+    // The index is complete before the archive is created, and never unloaded.
+    void load() {}
+    void unload() {}
+
+    DataStreamPtr open(const String& filename, bool readonly = true) const
+    {
+        return mVFS.open(filename);
+    }
+
+    bool exists(const String& filename)
+    {
+        return mVFS.exists(filename);
+    }
+
+    // Files in an archive change with the archive
+    time_t getModifiedTime(const String& filename)
+    {
+        const Bsa::VFS::File *file = mVFS.search(filename);
+
+        if (!file)
+            return 0;
+
+        return modifiedTime(file->mArchive ? file->mArchive->getFilename() : file->mPath);
+    }
+
+    StringVectorPtr list(bool recursive = true, bool dirs = false)
+    {
+        return find ("*", recursive, dirs);
+    }
+
+    FileInfoListPtr listFileInfo(bool recursive = true, bool dirs = false)
+    {
+        return findFileInfo ("*", recursive, dirs);
+    }
+
+    StringVectorPtr find(const String& pattern, bool recursive = true,
+                         bool dirs = false)
+    {
+        std::string normalizedPattern = Bsa::VFS::normalize(pattern);
+        StringVectorPtr ptr = StringVectorPtr(new StringVector());
+
+        // Plain names are looked up directly
+        if (!hasWildcard(normalizedPattern))
+        {
+            if (mVFS.exists(normalizedPattern))
+                ptr->push_back(normalizedPattern);
+            return ptr;
+        }
+
+        for(Bsa::VFS::Index::const_iterator iter = mVFS.begin();iter != mVFS.end();++iter)
+        {
+            if(normalizedPattern == "*" || matches(iter->first, normalizedPattern, recursive))
+                ptr->push_back(iter->first);
+        }
+        return ptr;
+    }
+
+    FileInfoListPtr findFileInfo(const String& pattern, bool recursive = true,
+                                 bool dirs = false) const
+    {
+        std::string normalizedPattern = Bsa::VFS::normalize(pattern);
+        FileInfoListPtr ptr = FileInfoListPtr(new FileInfoList());
+
+        // Plain names are looked up directly
+        if (!hasWildcard(normalizedPattern))
+        {
+            if (const Bsa::VFS::File *file = mVFS.search(pattern))
+                ptr->push_back(fileInfo(normalizedPattern, *file));
+            return ptr;
+        }
+
+        for(Bsa::VFS::Index::const_iterator iter = mVFS.begin();iter != mVFS.end();++iter)
+        {
+            if(matches(iter->first, normalizedPattern, recursive))
+                ptr->push_back(fileInfo(iter->first, iter->second));
         }
 
         return ptr;
     }
+
+private:
+
+    FileInfo fileInfo(const std::string& name, const Bsa::VFS::File& file) const
+    {
+        std::string::size_type pt = name.rfind('/');
+        if(pt == std::string::npos)
+            pt = 0;
+
+        FileInfo fi;
+        fi.archive = const_cast<VFSArchive*>(this);
+        fi.path = name.substr(0, pt);
+        fi.filename = name.substr((name[pt]=='/') ? pt+1 : pt);
+        fi.compressedSize = fi.uncompressedSize = file.mEntry ? file.mEntry->fileSize : 0;
+        return fi;
+    }
 };
 
 // An archive factory for BSA archives
@@ -338,8 +491,38 @@ public:
 };
 
 
+// An archive factory for the VFS. Ogre only passes the name to
+// createInstance(), so the index comes from addVFS().
+class VFSArchiveFactory : public ArchiveFactory
+{
+public:
+    static const Bsa::VFS *sVFS;
+
+    const String& getType() const
+    {
+      static String name = "VFS";
+      return name;
+    }
+
+    Archive *createInstance( const String& name )
+    {
+      return new VFSArchive(name, *sVFS);
+    }
+
+    virtual Archive* createInstance(const String& name, bool readOnly)
+    {
+      return new VFSArchive(name, *sVFS);
+    }
+
+    void destroyInstance( Archive* arch) { delete arch; }
+};
+
+const Bsa::VFS *VFSArchiveFactory::sVFS = 0;
+
+
 static bool init = false;
 static bool init2 = false;
+static bool init3 = false;
 
 static void insertBSAFactory()
 {
@@ -360,10 +543,20 @@ static void insertDirFactory()
 }
 
 
+static void insertVFSFactory()
+{
+  if(!init3)
+    {
+      ArchiveManager::getSingleton().addArchiveFactory( new VFSArchiveFactory );
+      init3 = true;
+    }
+}
+
+
 namespace Bsa
 {
 
-// The function below is the only publicly exposed part of this file
+// The functions below are the only publicly exposed part of this file
 
 void addBSA(const std::string& name, const std::string& group)
 {
@@ -381,4 +574,13 @@ void addDir(const std::string& name, const bool& fs, const std::string& group)
     addResourceLocation(name, "Dir", group, true);
 }
 
+void addVFS(const VFS& vfs, const std::string& group)
+{
+    insertVFSFactory();
+    VFSArchiveFactory::sVFS = &vfs;
+
+    ResourceGroupManager::getSingleton().
+    addResourceLocation("VFS", "VFS", group, true);
+}
+
 }
@@ -30,11 +30,17 @@
 namespace Bsa
 {
 
+class VFS;
+
 /// Add the given BSA file as an input archive in the Ogre resource
 /// system.
 void addBSA(const std::string& file, const std::string& group="General");
 void addDir(const std::string& file, const bool& fs, const std::string& group="General");
 
+/// Add all files indexed by \a vfs to the Ogre resource system, as a single
+/// input archive. \a vfs must not change or go away while Ogre uses it.
+void addVFS(const VFS& vfs, const std::string& group="General");
+
 }
 
 #endif
@@ -24,12 +24,37 @@
 #include "bsa_file.hpp"
 
 #include <stdexcept>
+#include <cassert>
+#include <cctype>
+#include <cstring>
 
-#include "../files/constrainedfiledatastream.hpp"
+#include "../misc/hash.hpp"
 
 using namespace std;
 using namespace Bsa;
 
+namespace
+{
+    /// A stream over part of a mapped archive. Holds on to the mapping,
+    /// so that it stays valid after the BSAFile is gone.
+    class MappedDataStream : public Ogre::MemoryDataStream
+    {
+        Files::MemoryMappedFilePtr mFile;
+
+    public:
+        MappedDataStream(const std::string &name, const Files::MemoryMappedFilePtr &file,
+            size_t offset, size_t size)
+          : Ogre::MemoryDataStream(name, const_cast<char*>(file->data()) + offset, size, false, true)
+          , mFile(file)
+        {}
+    };
+
+    inline char normalizeChar(char ch)
+    {
+        return ch == '/' ? '\\' : std::tolower(static_cast<unsigned char>(ch));
+    }
+}
+
 
 /// Error handling
 void BSAFile::fail(const string &msg)
@@ -72,15 +97,12 @@ void BSAFile::readHeader()
      */
     assert(!isLoaded);
 
-    std::ifstream input(filename.c_str(), std::ios_base::binary);
+    mFile = Files::openMemoryMappedFile(filename.c_str(), Files::MemoryMappedFile::Access_Random);
+
+    const char *data = mFile->data();
 
     // Total archive size
-    size_t fsize = 0;
-    if(input.seekg(0, std::ios_base::end))
-    {
-        fsize = input.tellg();
-        input.seekg(0);
-    }
+    size_t fsize = mFile->size();
 
     if(fsize < 12)
         fail("File too small to be a valid BSA archive");
@@ -91,7 +113,7 @@ void BSAFile::readHeader()
         // First 12 bytes
         uint32_t head[3];
 
-        input.read(reinterpret_cast<char*>(head), 12);
+        memcpy(head, data, 12);
 
         if(head[0] != 0x100)
             fail("Unrecognized BSA header");
@@ -107,25 +129,32 @@ void BSAFile::readHeader()
     // Each file must take up at least 21 bytes of data in the bsa. So
     // if files*21 overflows the file size then we are guaranteed that
     // the archive is corrupt.
-    if((filenum*21 > fsize -12) || (dirsize+8*filenum > fsize -12) )
+    if((filenum*21 > fsize -12) || (dirsize+8*filenum > fsize -12) || (12*filenum > dirsize))
         fail("Directory information larger than entire archive");
 
-    // Read the offset info into a temporary buffer
+    // The offset info, which is not necessarily aligned in memory
     vector<uint32_t> offsets(3*filenum);
-    input.read(reinterpret_cast<char*>(&offsets[0]), 12*filenum);
+    if(filenum > 0)
+        memcpy(&offsets[0], data + 12, 12*filenum);
 
-    // Read the string table
-    stringBuf.resize(dirsize-12*filenum);
-    input.read(&stringBuf[0], stringBuf.size());
+    // The string table, used in place
+    const char *stringBuf = data + 12 + 12*filenum;
+    size_t stringSize = dirsize-12*filenum;
 
-    // Check our position
-    assert(input.tellg() == std::streampos(12+dirsize));
+    if(filenum > 0 && (stringSize == 0 || stringBuf[stringSize-1] != 0))
+        fail("Unterminated file name table");
 
     // Calculate the offset of the data buffer. All file offsets are
     // relative to this. 12 header bytes + directory + hash table
     // (skipped)
     size_t fileDataOffset = 12 + dirsize + 8*filenum;
 
+    // Keep the load factor of the lookup table at or below 1/2
+    size_t tableSize = 16;
+    while(tableSize < 2*filenum)
+        tableSize *= 2;
+    lookup.assign(tableSize, 0);
+
     // Set up the the FileStruct table
     files.resize(filenum);
     for(size_t i=0;i<filenum;i++)
@@ -133,28 +162,57 @@ void BSAFile::readHeader()
         FileStruct &fs = files[i];
         fs.fileSize = offsets[i*2];
         fs.offset = offsets[i*2+1] + fileDataOffset;
-        fs.name = &stringBuf[offsets[2*filenum+i]];
+
+        if(offsets[2*filenum+i] >= stringSize)
+            fail("Archive contains file names outside itself");
+        fs.name = stringBuf + offsets[2*filenum+i];
 
         if(fs.offset + fs.fileSize > fsize)
             fail("Archive contains offsets outside itself");
 
-        // Add the file name to the lookup
-        lookup[fs.name] = i;
+        // Add the file name to the lookup. Later entries with the same
+        // name replace earlier ones, as they did in the old std::map.
+        size_t slot = hashName(fs.name) & (tableSize-1);
+        while(lookup[slot] != 0 && !equalNames(files[lookup[slot]-1].name, fs.name))
+            slot = (slot+1) & (tableSize-1);
+        lookup[slot] = i+1;
     }
 
     isLoaded = true;
 }
 
+size_t BSAFile::hashName(const char *str)
+{
+    // Over the normalized characters
+    Misc::Hash hash;
+    for(; *str; ++str)
+        hash.add(static_cast<unsigned char>(normalizeChar(*str)));
+    return static_cast<size_t>(hash.get());
+}
+
+bool BSAFile::equalNames(const char *s1, const char *s2)
+{
+    for(; *s1 && *s2; ++s1, ++s2)
+        if(normalizeChar(*s1) != normalizeChar(*s2))
+            return false;
+    return *s1 == *s2;
+}
+
 /// Get the index of a given file name, or -1 if not found
 int BSAFile::getIndex(const char *str) const
 {
-    Lookup::const_iterator it = lookup.find(str);
-    if(it == lookup.end())
+    if(lookup.empty())
         return -1;
 
-    int res = it->second;
-    assert(res >= 0 && (size_t)res < files.size());
-    return res;
+    size_t mask = lookup.size()-1;
+    for(size_t slot = hashName(str) & mask; lookup[slot] != 0; slot = (slot+1) & mask)
+    {
+        int res = lookup[slot]-1;
+        assert(res >= 0 && (size_t)res < files.size());
+        if(equalNames(files[res].name, str))
+            return res;
+    }
+    return -1;
 }
 
 /// Open an archive file.
@@ -171,6 +229,11 @@ Ogre::DataStreamPtr BSAFile::getFile(const char *file)
     if(i == -1)
         fail("File not found: " + string(file));
 
-    const FileStruct &fs = files[i];
-	return openConstrainedFileDataStream (filename.c_str (), fs.offset, fs.fileSize);
+    return getFile(&files[i]);
+}
+
+Ogre::DataStreamPtr BSAFile::getFile(const FileStruct *file) const
+{
+    assert(file);
+    return Ogre::DataStreamPtr(new MappedDataStream(file->name, mFile, file->offset, file->fileSize));
 }
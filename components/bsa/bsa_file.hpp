@@ -28,10 +28,11 @@
 #include <libs/platform/strings.h>
 #include <string>
 #include <vector>
-#include <map>
 
 #include <OgreDataStream.h>
 
+#include "../files/memorymappedfile.hpp"
+
 
 namespace Bsa
 {
@@ -59,8 +60,9 @@ private:
     /// Table of files in this archive
     FileList files;
 
-    /// Filename string buffer
-    std::vector<char> stringBuf;
+    /// The archive, mapped into memory. File names and file data point
+    /// into it.
+    Files::MemoryMappedFilePtr mFile;
 
     /// True when an archive has been loaded
     bool isLoaded;
@@ -68,19 +70,18 @@ private:
     /// Used for error messages
     std::string filename;
 
-    /// Case insensitive string comparison
-    struct iltstr
-    {
-        bool operator()(const char *s1, const char *s2) const
-        { return strcasecmp(s1,s2) < 0; }
-    };
-
-    /** A map used for fast file name lookup. The value is the index into
-        the files[] vector above. The iltstr ensures that file name
-        checks are case insensitive.
+    /** Hash table used for fast file name lookup, with linear probing.
+        Each slot holds an index into the files[] vector above plus one,
+        or 0 if empty. Names are compared case insensitively and with '/'
+        and '\\' treated as the same character.
     */
-    typedef std::map<const char*, int, iltstr> Lookup;
-    Lookup lookup;
+    std::vector<int> lookup;
+
+    /// Hash of a file name, consistent with the comparison used by lookup
+    static size_t hashName(const char *str);
+
+    /// Compare file names the way lookup does
+    static bool equalNames(const char *s1, const char *s2);
 
     /// Error handling
     void fail(const std::string &msg);
@@ -113,14 +114,29 @@ public:
     bool exists(const char *file) const
     { return getIndex(file) != -1; }
 
+    /// Entry of a file, or 0 if it doesn't exist
+    const FileStruct *search(const char *file) const
+    {
+        int i = getIndex(file);
+        return (i != -1) ? &files[i] : 0;
+    }
+
     /** Open a file contained in the archive. Throws an exception if the
-        file doesn't exist.
+        file doesn't exist. The stream reads straight from the mapped
+        archive, and keeps it mapped while the stream exists.
     */
     Ogre::DataStreamPtr getFile(const char *file);
 
+    /// Open a file from getList(), without looking up its name
+    Ogre::DataStreamPtr getFile(const FileStruct *file) const;
+
     /// Get a list of all files
     const FileList &getList() const
     { return files; }
+
+    /// Path of the archive file
+    const std::string &getFilename() const
+    { return filename; }
 };
 
 }
@@ -0,0 +1,316 @@
+#include "vfs.hpp"
+
+#include <cctype>
+#include <list>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+
+#include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+
+#include "../files/constrainedfiledatastream.hpp"
+
+namespace
+{
+    std::string normalizeSeparators(const std::string &name)
+    {
+        std::string normalized(name);
+        for (std::string::iterator it = normalized.begin(); it != normalized.end(); ++it)
+            if (*it == '\\')
+                *it = '/';
+        return normalized;
+    }
+}
+
+namespace Bsa
+{
+
+/// Worker threads reading requested files into memory. Each file is handed
+/// out once, by take().
+class VFS::Prefetcher
+{
+    struct Entry
+    {
+        Ogre::MemoryDataStream *mData;
+        std::list<std::string>::iterator mAge;
+    };
+
+    typedef std::tr1::unordered_map<std::string, Entry> Cache;
+
+    const VFS &mVFS;
+    size_t mBudget;
+    size_t mSize;
+    bool mStop;
+
+    std::deque<std::string> mQueue;
+    std::set<std::string> mPending; // queued or being read
+    Cache mCache;
+    std::list<std::string> mAges; // cached keys, oldest first
+
+    boost::mutex mMutex;
+    boost::condition_variable mCondition;
+    boost::thread_group mThreads;
+
+    void run();
+
+    void drop(Cache::iterator it);
+
+public:
+    Prefetcher(const VFS &vfs, unsigned int threads, size_t budget);
+
+    ~Prefetcher();
+
+    void request(const std::string &key);
+
+    /// Remove \a key from the cache; returns a null pointer if it is not there.
+    Ogre::DataStreamPtr take(const std::string &key);
+};
+
+VFS::Prefetcher::Prefetcher(const VFS &vfs, unsigned int threads, size_t budget)
+  : mVFS(vfs), mBudget(budget), mSize(0), mStop(false)
+{
+    for (unsigned int i = 0; i < threads; ++i)
+        mThreads.create_thread(boost::bind(&Prefetcher::run, this));
+}
+
+VFS::Prefetcher::~Prefetcher()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mMutex);
+        mStop = true;
+    }
+    mCondition.notify_all();
+    mThreads.join_all();
+
+    while (!mCache.empty())
+        drop(mCache.begin());
+}
+
+void VFS::Prefetcher::drop(Cache::iterator it)
+{
+    mSize -= it->second.mData->size();
+    delete it->second.mData;
+    mAges.erase(it->second.mAge);
+    mCache.erase(it);
+}
+
+void VFS::Prefetcher::request(const std::string &key)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mMutex);
+
+        if (mCache.find(key) != mCache.end() || !mPending.insert(key).second)
+            return;
+
+        mQueue.push_back(key);
+    }
+    mCondition.notify_one();
+}
+
+Ogre::DataStreamPtr VFS::Prefetcher::take(const std::string &key)
+{
+    boost::unique_lock<boost::mutex> lock(mMutex);
+
+    Cache::iterator it = mCache.find(key);
+    if (it == mCache.end())
+        return Ogre::DataStreamPtr();
+
+    Ogre::MemoryDataStream *data = it->second.mData;
+    mSize -= data->size();
+    mAges.erase(it->second.mAge);
+    mCache.erase(it);
+
+    return Ogre::DataStreamPtr(data);
+}
+
+void VFS::Prefetcher::run()
+{
+    while (true)
+    {
+        std::string key;
+        {
+            boost::unique_lock<boost::mutex> lock(mMutex);
+            while (mQueue.empty() && !mStop)
+                mCondition.wait(lock);
+
+            if (mStop)
+                return;
+
+            key = mQueue.front();
+            mQueue.pop_front();
+        }
+
+        // mIndex does not change while prefetching, so no lock is needed to read it
+        Ogre::MemoryDataStream *data = 0;
+        try
+        {
+            Index::const_iterator it = mVFS.mIndex.find(key);
+            if (it != mVFS.mIndex.end())
+            {
+                Ogre::DataStreamPtr source = mVFS.openFile(it->second);
+                data = new Ogre::MemoryDataStream(key, source, true, true);
+            }
+        }
+        catch (const std::exception &)
+        {
+            // Ignored; open() reports the error when the file is actually needed
+        }
+
+        boost::unique_lock<boost::mutex> lock(mMutex);
+        mPending.erase(key);
+
+        if (!data)
+            continue;
+
+        if (mStop || data->size() > mBudget)
+        {
+            delete data;
+            continue;
+        }
+
+        while (mSize + data->size() > mBudget)
+            drop(mCache.find(mAges.front()));
+
+        Entry &entry = mCache[key];
+        entry.mData = data;
+        entry.mAge = mAges.insert(mAges.end(), key);
+        mSize += data->size();
+    }
+}
+
+VFS::VFS()
+  : mStrict(false), mPrefetcher(0)
+{}
+
+VFS::~VFS()
+{
+    delete mPrefetcher;
+}
+
+std::string VFS::normalize(const std::string &name)
+{
+    std::string normalized(name);
+    for (std::string::iterator it = normalized.begin(); it != normalized.end(); ++it)
+        *it = (*it == '\\') ? '/' : std::tolower(static_cast<unsigned char>(*it));
+    return normalized;
+}
+
+void VFS::addDir(const std::string &path, bool strict)
+{
+    mStrict = strict;
+
+    typedef boost::filesystem::recursive_directory_iterator directory_iterator;
+
+    directory_iterator end;
+
+    size_t prefix = path.size ();
+
+    if (path.size () > 0 && path [prefix - 1] != '\\' && path [prefix - 1] != '/')
+        ++prefix;
+
+    for (directory_iterator i (path); i != end; ++i)
+    {
+        if(boost::filesystem::is_directory (*i))
+            continue;
+
+        std::string proper = i->path ().string ();
+        std::string name = proper.substr (prefix);
+
+        // Loose files replace anything added before
+        File &file = mIndex[normalize (name)];
+        file.mArchive = 0;
+        file.mEntry = 0;
+        file.mPath = proper;
+        file.mStrictName = normalizeSeparators (name);
+    }
+}
+
+void VFS::addBSA(const std::string &file)
+{
+    mArchives.push_back(BSAFile());
+    BSAFile &archive = mArchives.back();
+    archive.open(file);
+
+    const BSAFile::FileList &files = archive.getList();
+    for (BSAFile::FileList::const_iterator it = files.begin(); it != files.end(); ++it)
+    {
+        std::pair<Index::iterator, bool> result =
+            mIndex.insert(std::make_pair(normalize(it->name), File()));
+
+        File &entry = result.first->second;
+
+        // Archives never replace loose files
+        if (!result.second && entry.mArchive == 0)
+            continue;
+
+        entry.mArchive = &archive;
+        entry.mEntry = &*it;
+    }
+}
+
+const VFS::File *VFS::search(const std::string &name) const
+{
+    Index::const_iterator it = mIndex.find(normalize(name));
+    if (it == mIndex.end())
+        return 0;
+
+    const File &file = it->second;
+
+    if (mStrict && file.mArchive == 0 && file.mStrictName != normalizeSeparators(name))
+        return 0;
+
+    return &file;
+}
+
+bool VFS::exists(const std::string &name) const
+{
+    return search(name) != 0;
+}
+
+Ogre::DataStreamPtr VFS::open(const std::string &name) const
+{
+    const File *file = search(name);
+
+    if (!file)
+    {
+        std::ostringstream os;
+        os << "The file '" << name << "' could not be found.";
+        throw std::runtime_error (os.str ());
+    }
+
+    if (mPrefetcher)
+    {
+        Ogre::DataStreamPtr stream = mPrefetcher->take(normalize(name));
+        if (!stream.isNull())
+            return stream;
+    }
+
+    return openFile(*file);
+}
+
+Ogre::DataStreamPtr VFS::openFile(const File &file) const
+{
+    if (file.mArchive)
+        return file.mArchive->getFile(file.mEntry);
+
+    return openConstrainedFileDataStream (file.mPath.c_str ());
+}
+
+void VFS::startPrefetching(unsigned int threads, size_t budget)
+{
+    delete mPrefetcher;
+    mPrefetcher = 0;
+
+    if (threads > 0)
+        mPrefetcher = new Prefetcher(*this, threads, budget);
+}
+
+void VFS::prefetch(const std::string &name) const
+{
+    if (mPrefetcher && search(name))
+        mPrefetcher->request(normalize(name));
+}
+
+}
@@ -0,0 +1,108 @@
+#ifndef BSA_VFS_H
+#define BSA_VFS_H
+
+#include <string>
+#include <deque>
+
+#ifdef _WIN32
+#include <boost/tr1/tr1/unordered_map>
+#elif defined HAVE_UNORDERED_MAP
+#include <unordered_map>
+#else
+#include <tr1/unordered_map>
+#endif
+
+#include <OgreDataStream.h>
+
+#include "bsa_file.hpp"
+
+namespace Bsa
+{
+
+/**
+   One index over the files of all data directories and BSA archives.
+
+   Files are looked up by their normalized path (lower case, with '/' as
+   separator) in a single hash table, instead of asking each archive in
+   turn. Loose files in data directories take precedence over files in
+   archives. Otherwise the directory or archive added last wins.
+
+   Files can be prefetched: worker threads read them into memory ahead of
+   time, and the next open() of such a file is served from there.
+ */
+class VFS
+{
+public:
+    struct File
+    {
+        /// Archive containing the file, or 0 for a loose file
+        const BSAFile *mArchive;
+        const BSAFile::FileStruct *mEntry;
+
+        /// Full path of a loose file
+        std::string mPath;
+
+        /// Path relative to the data directory with only the separators
+        /// normalized, for strict file system handling
+        std::string mStrictName;
+    };
+
+    typedef std::tr1::unordered_map<std::string, File> Index;
+
+private:
+    class Prefetcher;
+
+    Index mIndex;
+
+    /// BSAFile never moves, so File::mArchive stays valid
+    std::deque<BSAFile> mArchives;
+
+    bool mStrict;
+
+    Prefetcher *mPrefetcher;
+
+    Ogre::DataStreamPtr openFile(const File &file) const;
+
+    // not implemented
+    VFS(const VFS&);
+    VFS& operator=(const VFS&);
+
+public:
+    VFS();
+
+    ~VFS();
+
+    /// Normalize \a name into a key of the index
+    static std::string normalize(const std::string &name);
+
+    /// Add all files below \a path.
+    /// \param strict Names of loose files are case sensitive.
+    void addDir(const std::string &path, bool strict);
+
+    void addBSA(const std::string &file);
+
+    bool exists(const std::string &name) const;
+
+    /// Entry of \a name, or 0 if it doesn't exist
+    const File *search(const std::string &name) const;
+
+    /// Throws an exception if the file doesn't exist.
+    Ogre::DataStreamPtr open(const std::string &name) const;
+
+    /// Start \a threads worker threads for prefetch(), keeping at most
+    /// \a budget bytes of prefetched data. The oldest files are dropped first.
+    /// \note Add all directories and archives before.
+    void startPrefetching(unsigned int threads, size_t budget);
+
+    /// Read \a name into memory in the background, if it exists and
+    /// prefetching has been started. Can be called from any thread.
+    void prefetch(const std::string &name) const;
+
+    /// Iterate over all files, keyed by normalized path
+    Index::const_iterator begin() const { return mIndex.begin(); }
+    Index::const_iterator end() const { return mIndex.end(); }
+};
+
+}
+
+#endif
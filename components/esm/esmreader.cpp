@@ -1,7 +1,6 @@
 #include "esmreader.hpp"
 #include <stdexcept>
-
-#include "../files/constrainedfiledatastream.hpp"
+#include <algorithm>
 
 namespace ESM
 {
@@ -11,7 +10,7 @@ using namespace Misc;
 ESM_Context ESMReader::getContext()
 {
     // Update the file position before returning
-    mCtx.filePos = mEsm->tell();
+    mCtx.filePos = tell();
     return mCtx;
 }
 
@@ -21,6 +20,8 @@ ESMReader::ESMReader()
     , mIdx(0)
     , mGlobalReaderList(NULL)
     , mEncoder(NULL)
+    , mPos(NULL)
+    , mEnd(NULL)
 {
 }
 
@@ -39,12 +40,14 @@ void ESMReader::restoreContext(const ESM_Context &rc)
     mCtx = rc;
 
     // Make sure we seek to the right place
-    mEsm->seek(mCtx.filePos);
+    seek(mCtx.filePos);
 }
 
 void ESMReader::close()
 {
     mEsm.setNull();
+    mFile.reset();
+    mPos = mEnd = NULL;
     mCtx.filename.clear();
     mCtx.leftFile = 0;
     mCtx.leftRec = 0;
@@ -65,23 +68,33 @@ void ESMReader::openRaw(Ogre::DataStreamPtr _esm, const std::string &name)
 void ESMReader::open(Ogre::DataStreamPtr _esm, const std::string &name)
 {
     openRaw(_esm, name);
-
-    if (getRecName() != "TES3")
-        fail("Not a valid Morrowind file");
-
-    getRecHeader();
-
-    mHeader.load (*this);
+    readHeader();
 }
 
 void ESMReader::open(const std::string &file)
 {
-    open (openConstrainedFileDataStream (file.c_str ()), file);
+    openRaw(file);
+    readHeader();
 }
 
 void ESMReader::openRaw(const std::string &file)
 {
-    openRaw (openConstrainedFileDataStream (file.c_str ()), file);
+    close();
+    mFile = Files::openMemoryMappedFile (file.c_str ());
+    mPos = mFile->data();
+    mEnd = mPos + mFile->size();
+    mCtx.filename = file;
+    mCtx.leftFile = mFile->size();
+}
+
+void ESMReader::readHeader()
+{
+    if (getRecName() != "TES3")
+        fail("Not a valid Morrowind file");
+
+    getRecHeader();
+
+    mHeader.load (*this);
 }
 
 int64_t ESMReader::getHNLong(const char *name)
@@ -117,8 +130,7 @@ std::string ESMReader::getHString()
     {
         // Skip the following zero byte
         mCtx.leftRec--;
-        char c;
-        mEsm->read(&c, 1);
+        skip(1);
         return "";
     }
 
@@ -177,7 +189,7 @@ void ESMReader::getSubName()
     }
 
     // reading the subrecord data anyway.
-    mEsm->read(mCtx.subName.name, 4);
+    getExact(mCtx.subName.name, 4);
     mCtx.leftRec -= 4;
 }
 
@@ -185,7 +197,7 @@ bool ESMReader::isEmptyOrGetName()
 {
     if (mCtx.leftRec)
     {
-        mEsm->read(mCtx.subName.name, 4);
+        getExact(mCtx.subName.name, 4);
         mCtx.leftRec -= 4;
         return false;
     }
@@ -280,7 +292,16 @@ void ESMReader::getRecHeader(uint32_t &flags)
  *
  *************************************************************************/
 
-void ESMReader::getExact(void*x, int size)
+void ESMReader::seek(size_t pos)
+{
+    if (mFile)
+        // Like a stream, clamp to the end and let the next read fail
+        mPos = mFile->data() + std::min(pos, mFile->size());
+    else
+        mEsm->seek(pos);
+}
+
+void ESMReader::getExactFromStream(void*x, int size)
 {
     int t = mEsm->read(x, size);
     if (t != size)
@@ -290,6 +311,18 @@ void ESMReader::getExact(void*x, int size)
 std::string ESMReader::getString(int size)
 {
     size_t s = size;
+
+    // Strings in a mapped file can be converted in place, without a
+    // copy into mBuffer, as long as they carry their own terminator.
+    if (mFile && s > 0 && s <= static_cast<size_t>(mEnd - mPos) && mPos[s-1] == 0)
+    {
+        const char *ptr = mPos;
+        mPos += s;
+        if (!mEncoder)
+            return std::string(ptr);
+        return mEncoder->getUtf8(ptr, s-1);
+    }
+
     if (mBuffer.size() <= s)
         // Add some extra padding to reduce the chance of having to resize
         // again later.
@@ -302,6 +335,10 @@ std::string ESMReader::getString(int size)
     char *ptr = &mBuffer[0];
     getExact(ptr, size);
 
+    // Without an encoder the data is taken to be UTF8 already
+    if (!mEncoder)
+        return std::string(ptr);
+
     // Convert to UTF8 and return
     return mEncoder->getUtf8(ptr, size);
 }
@@ -316,8 +353,8 @@ void ESMReader::fail(const std::string &msg)
     ss << "\n  File: " << mCtx.filename;
     ss << "\n  Record: " << mCtx.recName.toString();
     ss << "\n  Subrecord: " << mCtx.subName.toString();
-    if (!mEsm.isNull())
-        ss << "\n  Offset: 0x" << hex << mEsm->tell();
+    if (!mEsm.isNull() || mFile)
+        ss << "\n  Offset: 0x" << hex << tell();
     throw std::runtime_error(ss.str());
 }
 
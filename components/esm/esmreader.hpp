@@ -4,6 +4,7 @@
 #include <libs/platform/stdint.h>
 #include <libs/platform/string.h>
 #include <cassert>
+#include <cstring>
 #include <vector>
 #include <sstream>
 
@@ -11,6 +12,8 @@
 
 #include <components/misc/stringops.hpp>
 
+#include <components/files/memorymappedfile.hpp>
+
 #include <components/to_utf8/to_utf8.hpp>
 
 #include "esmcommon.hpp"
@@ -66,14 +69,17 @@ public:
   /// currently open file first, if any.
   void open(Ogre::DataStreamPtr _esm, const std::string &name);
 
+  /// Load ES file from disk, parses the header. The file is mapped into
+  /// memory and all reads are served directly from the mapping.
   void open(const std::string &file);
 
+  /// Raw opening of a file on disk, using a memory mapping like open().
   void openRaw(const std::string &file);
 
   /// Get the file size. Make sure that the file has been opened!
-  size_t getFileSize() { return mEsm->size(); }
+  size_t getFileSize() { return mFile ? mFile->size() : mEsm->size(); }
   /// Get the current position in the file. Make sure that the file has been opened!
-  size_t getFileOffset() { return mEsm->tell(); }
+  size_t getFileOffset() { return tell(); }
 
   // This is a quick hack for multiple esm/esp files. Each plugin introduces its own
   //  terrain palette, but ESMReader does not pass a reference to the correct plugin
@@ -178,6 +184,10 @@ public:
    */
   bool isNextSub(const char* name);
 
+  // Put the subrecord name that was just read back, so that the next
+  // getSubName() returns it again.
+  void cacheSubName() { mCtx.subCached = true; }
+
   // Read subrecord name. This gets called a LOT, so I've optimized it
   // slightly.
   void getSubName();
@@ -237,7 +247,19 @@ public:
   template <typename X>
   void getT(X &x) { getExact(&x, sizeof(X)); }
 
-  void getExact(void*x, int size);
+  void getExact(void*x, int size)
+  {
+      if (mFile)
+      {
+          if (static_cast<size_t>(mEnd - mPos) < static_cast<size_t>(size))
+              fail("Read error");
+          std::memcpy(x, mPos, size);
+          mPos += size;
+      }
+      else
+          getExactFromStream(x, size);
+  }
+
   void getName(NAME &name) { getT(name); }
   void getUint(uint32_t &u) { getT(u); }
 
@@ -245,21 +267,36 @@ public:
   // them from native encoding to UTF8 in the process.
   std::string getString(int size);
 
-  void skip(int bytes) { mEsm->seek(mEsm->tell()+bytes); }
-  uint64_t getOffset() { return mEsm->tell(); }
+  void skip(int bytes) { seek(tell()+bytes); }
+  uint64_t getOffset() { return tell(); }
 
   /// Used for error handling
   void fail(const std::string &msg);
 
-  /// Sets font encoder for ESM strings
+  /// Sets font encoder for ESM strings. Without an encoder, strings are
+  /// returned as they are stored in the file.
   void setEncoder(ToUTF8::Utf8Encoder* encoder);
+  ToUTF8::Utf8Encoder* getEncoder() { return mEncoder; }
 
   /// Get record flags of last record
   unsigned int getRecordFlags() { return mRecordFlags; }
 
 private:
+  void readHeader();
+
+  size_t tell() { return mFile ? static_cast<size_t>(mPos - mFile->data()) : mEsm->tell(); }
+  void seek(size_t pos);
+
+  void getExactFromStream(void*x, int size);
+
   Ogre::DataStreamPtr mEsm;
 
+  // Set instead of mEsm when the file was opened from disk. mPos and
+  // mEnd point into the mapped file data.
+  Files::MemoryMappedFilePtr mFile;
+  const char *mPos;
+  const char *mEnd;
+
   ESM_Context mCtx;
 
   unsigned int mRecordFlags;
@@ -1,12 +1,13 @@
 #include "esmwriter.hpp"
 
 #include <cassert>
+#include <cstring>
 #include <fstream>
 #include <stdexcept>
 
 namespace ESM
 {
-    ESMWriter::ESMWriter() : mRecordCount (0), mCounting (true) {}
+    ESMWriter::ESMWriter() : mStream (NULL), mEncoder (NULL), mRecordCount (0) {}
 
     unsigned int ESMWriter::getVersion() const
     {
@@ -61,7 +62,7 @@ namespace ESM
     {
         mRecordCount = 0;
         mRecords.clear();
-        mCounting = true;
+        mBuffer.clear();
         mStream = &file;
 
         startRecord("TES3", 0);
@@ -75,6 +76,36 @@ namespace ESM
     {
         if (!mRecords.empty())
             throw std::runtime_error ("Unclosed record remaining");
+
+        flush();
+    }
+
+    void ESMWriter::takeRecords(std::string& records)
+    {
+        assert(!mStream);
+        if (!mRecords.empty())
+            throw std::runtime_error ("Unclosed record remaining");
+
+        records.swap(mBuffer);
+        mBuffer.clear();
+    }
+
+    void ESMWriter::writeRecords(const std::string& records)
+    {
+        if (!mRecords.empty())
+            throw std::runtime_error ("Can not add records inside a record");
+
+        mBuffer.append(records);
+        flush();
+    }
+
+    void ESMWriter::flush()
+    {
+        if (mStream)
+        {
+            mStream->write(mBuffer.data(), mBuffer.size());
+            mBuffer.clear();
+        }
     }
 
     void ESMWriter::startRecord(const std::string& name, uint32_t flags)
@@ -84,7 +115,7 @@ namespace ESM
         writeName(name);
         RecordData rec;
         rec.name = name;
-        rec.position = mStream->tellp();
+        rec.position = mBuffer.size();
         rec.size = 0;
         writeT<int>(0); // Size goes here
         writeT<int>(0); // Unused header?
@@ -99,7 +130,7 @@ namespace ESM
         writeName(name);
         RecordData rec;
         rec.name = name;
-        rec.position = mStream->tellp();
+        rec.position = mBuffer.size();
         rec.size = 0;
         writeT<int>(0); // Size goes here
         mRecords.push_back(rec);
@@ -113,14 +144,12 @@ namespace ESM
         assert(rec.name == name);
         mRecords.pop_back();
 
-        mStream->seekp(rec.position);
-
-        mCounting = false;
-        write (reinterpret_cast<const char*> (&rec.size), sizeof(int));
-        mCounting = true;
-
-        mStream->seekp(0, std::ios::end);
+        int size = rec.size;
+        std::memcpy(&mBuffer[rec.position], &size, sizeof(int));
 
+        // Once the outermost record is complete, it can go to the stream
+        if (mRecords.empty())
+            flush();
     }
 
     void ESMWriter::writeHNString(const std::string& name, const std::string& data)
@@ -149,6 +178,8 @@ namespace ESM
     {
         if (data.size() == 0)
             write("\0", 1);
+        else if (!mEncoder)
+            write(data.c_str(), data.size());
         else
         {
             // Convert to UTF8 and return
@@ -173,17 +204,19 @@ namespace ESM
 
     void ESMWriter::write(const char* data, size_t size)
     {
-        if (mCounting && !mRecords.empty())
-        {
-            for (std::list<RecordData>::iterator it = mRecords.begin(); it != mRecords.end(); ++it)
-                it->size += size;
-        }
+        for (std::list<RecordData>::iterator it = mRecords.begin(); it != mRecords.end(); ++it)
+            it->size += size;
 
-        mStream->write(data, size);
+        mBuffer.append(data, size);
     }
 
     void ESMWriter::setEncoder(ToUTF8::Utf8Encoder* encoder)
     {
         mEncoder = encoder;
     }
+
+    ToUTF8::Utf8Encoder* ESMWriter::getEncoder()
+    {
+        return mEncoder;
+    }
 }
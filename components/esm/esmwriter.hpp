@@ -16,7 +16,7 @@ class ESMWriter
         struct RecordData
         {
             std::string name;
-            std::streampos position;
+            size_t position; // of the size field in mBuffer
             size_t size;
         };
 
@@ -27,6 +27,8 @@ class ESMWriter
         unsigned int getVersion() const;
         void setVersion(unsigned int ver = 0x3fa66666);
         void setEncoder(ToUTF8::Utf8Encoder *encoding);
+        ///< Without an encoder, strings are written unconverted.
+        ToUTF8::Utf8Encoder* getEncoder();
         void setAuthor(const std::string& author);
         void setDescription(const std::string& desc);
         void setRecordCount (int count);
@@ -45,6 +47,14 @@ class ESMWriter
         void close();
         ///< \note Does not close the stream.
 
+        void takeRecords(std::string& records);
+        ///< Move the records written so far into \a records. Only for a writer that
+        /// has not been given a stream with save(): such a writer keeps records in
+        /// memory, e.g. to serialise them on a worker thread.
+
+        void writeRecords(const std::string& records);
+        ///< Append records serialised by another writer (see takeRecords()).
+
         void writeHNString(const std::string& name, const std::string& data);
         void writeHNString(const std::string& name, const std::string& data, size_t size);
         void writeHNCString(const std::string& name, const std::string& data)
@@ -101,12 +111,14 @@ class ESMWriter
         void write(const char* data, size_t size);
 
     private:
+        void flush();
+        ///< Write buffered records to the stream, if there is one.
+
         std::list<RecordData> mRecords;
+        std::string mBuffer; ///< Data of the records that are still open
         std::ostream* mStream;
-        std::streampos mHeaderPos;
         ToUTF8::Utf8Encoder* mEncoder;
         int mRecordCount;
-        bool mCounting;
 
         Header mHeader;
     };
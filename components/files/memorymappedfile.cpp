@@ -0,0 +1,240 @@
+#include "memorymappedfile.hpp"
+
+#include "lowlevelfile.hpp"
+
+#include <stdexcept>
+#include <sstream>
+#include <cassert>
+
+#if FILE_API == FILE_API_POSIX
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
+namespace
+{
+	// Zero-length files can not be mapped; point them at a valid, empty buffer instead.
+	char const sEmpty [1] = { 0 };
+
+	void throwOpenError (char const * filename)
+	{
+		std::ostringstream os;
+		os << "Failed to open '" << filename << "' for reading.";
+		throw std::runtime_error (os.str ());
+	}
+}
+
+namespace Files
+{
+
+MemoryMappedFile::MemoryMappedFile ()
+	: mData (NULL), mSize (0), mMapped (false)
+{
+}
+
+MemoryMappedFile::~MemoryMappedFile ()
+{
+	if (mData != NULL)
+		close ();
+}
+
+#if FILE_API == FILE_API_POSIX
+/*
+ *
+ *	Implementation using mmap
+ *
+ */
+
+void MemoryMappedFile::open (char const * filename, Access access)
+{
+	assert (mData == NULL);
+
+#ifdef O_BINARY
+	static const int openFlags = O_RDONLY | O_BINARY;
+#else
+	static const int openFlags = O_RDONLY;
+#endif
+
+	int handle = ::open (filename, openFlags, 0);
+
+	if (handle == -1)
+		throwOpenError (filename);
+
+	struct stat info;
+
+	if (::fstat (handle, &info) == -1)
+	{
+		::close (handle);
+		throw std::runtime_error ("A query operation on a file failed.");
+	}
+
+	mSize = size_t (info.st_size);
+
+	if (mSize == 0)
+	{
+		::close (handle);
+		mData = sEmpty;
+		return;
+	}
+
+	void * view = ::mmap (NULL, mSize, PROT_READ, MAP_PRIVATE, handle, 0);
+
+	// The mapping holds its own reference to the file.
+	::close (handle);
+
+	if (view == MAP_FAILED)
+	{
+		mSize = 0;
+		throw std::runtime_error ("Failed to map file into memory.");
+	}
+
+	::madvise (view, mSize, access == Access_Random ? MADV_RANDOM : MADV_SEQUENTIAL);
+
+	mData = static_cast<char const *> (view);
+	mMapped = true;
+}
+
+void MemoryMappedFile::close ()
+{
+	assert (mData != NULL);
+
+	if (mMapped)
+		::munmap (const_cast<char *> (mData), mSize);
+
+	mData = NULL;
+	mSize = 0;
+	mMapped = false;
+}
+
+#elif FILE_API == FILE_API_WIN32
+/*
+ *
+ *	Implementation using Win32 file mappings
+ *
+ */
+
+void MemoryMappedFile::open (char const * filename, Access access)
+{
+	assert (mData == NULL);
+
+	HANDLE handle = CreateFileA (filename, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, 0, 0);
+
+	if (handle == INVALID_HANDLE_VALUE)
+		throwOpenError (filename);
+
+	BY_HANDLE_FILE_INFORMATION info;
+
+	if (!GetFileInformationByHandle (handle, &info))
+	{
+		CloseHandle (handle);
+		throw std::runtime_error ("A query operation on a file failed.");
+	}
+
+	if (info.nFileSizeHigh != 0)
+	{
+		CloseHandle (handle);
+		throw std::runtime_error ("Files greater that 4GB are not supported.");
+	}
+
+	mSize = info.nFileSizeLow;
+
+	if (mSize == 0)
+	{
+		CloseHandle (handle);
+		mData = sEmpty;
+		return;
+	}
+
+	HANDLE mapping = CreateFileMappingA (handle, NULL, PAGE_READONLY, 0, 0, NULL);
+
+	CloseHandle (handle);
+
+	if (mapping == NULL)
+	{
+		mSize = 0;
+		throw std::runtime_error ("Failed to map file into memory.");
+	}
+
+	void * view = MapViewOfFile (mapping, FILE_MAP_READ, 0, 0, 0);
+
+	// The view holds its own reference to the mapping object.
+	CloseHandle (mapping);
+
+	if (view == NULL)
+	{
+		mSize = 0;
+		throw std::runtime_error ("Failed to map file into memory.");
+	}
+
+	mData = static_cast<char const *> (view);
+	mMapped = true;
+}
+
+void MemoryMappedFile::close ()
+{
+	assert (mData != NULL);
+
+	if (mMapped)
+		UnmapViewOfFile (mData);
+
+	mData = NULL;
+	mSize = 0;
+	mMapped = false;
+}
+
+#else
+/*
+ *
+ *	Fallback: read the whole file into memory
+ *
+ */
+
+void MemoryMappedFile::open (char const * filename, Access access)
+{
+	assert (mData == NULL);
+
+	LowLevelFile file;
+	file.open (filename);
+
+	mSize = file.size ();
+	mBuffer.resize (mSize + 1);
+
+	size_t total = 0;
+
+	while (total < mSize)
+	{
+		size_t amount = file.read (&mBuffer [total], mSize - total);
+
+		if (amount == 0)
+			throw std::runtime_error ("A read operation on a file failed.");
+
+		total += amount;
+	}
+
+	mData = &mBuffer [0];
+}
+
+void MemoryMappedFile::close ()
+{
+	assert (mData != NULL);
+
+	std::vector<char> ().swap (mBuffer);
+
+	mData = NULL;
+	mSize = 0;
+	mMapped = false;
+}
+
+#endif
+
+MemoryMappedFilePtr openMemoryMappedFile (char const * filename, MemoryMappedFile::Access access)
+{
+	MemoryMappedFilePtr file (new MemoryMappedFile);
+	file->open (filename, access);
+	return file;
+}
+
+}
@@ -0,0 +1,55 @@
+#ifndef COMPONENTS_FILES_MEMORYMAPPEDFILE_HPP
+#define COMPONENTS_FILES_MEMORYMAPPEDFILE_HPP
+
+#include <cstdlib>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+namespace Files
+{
+	/// \brief Read-only view of a complete file in memory
+	///
+	/// The file is mapped into the address space where the platform supports it, otherwise
+	/// it is read into a heap buffer once. Either way data() stays valid until close().
+	class MemoryMappedFile
+	{
+	public:
+
+		/// How the file will be read, as a hint for the platform
+		enum Access
+		{
+			Access_Sequential,
+			Access_Random
+		};
+
+		MemoryMappedFile ();
+		~MemoryMappedFile ();
+
+		void open (char const * filename, Access access = Access_Sequential);
+		void close ();
+
+		bool isOpen () const { return mData != NULL; }
+
+		char const * data () const { return mData; }
+		size_t size () const { return mSize; }
+
+	private:
+
+		MemoryMappedFile (const MemoryMappedFile&);
+		MemoryMappedFile& operator= (const MemoryMappedFile&);
+
+		char const * mData;
+		size_t mSize;
+
+		bool mMapped;
+		std::vector<char> mBuffer;
+	};
+
+	typedef boost::shared_ptr<MemoryMappedFile> MemoryMappedFilePtr;
+
+	MemoryMappedFilePtr openMemoryMappedFile (char const * filename,
+		MemoryMappedFile::Access access = MemoryMappedFile::Access_Sequential);
+}
+
+#endif
@@ -0,0 +1,44 @@
+#include "cachefile.hpp"
+
+#include <sstream>
+#include <iomanip>
+
+#include <boost/filesystem.hpp>
+
+#include "hash.hpp"
+
+namespace Misc
+{
+    CacheFile::CacheFile (const std::string &dir, const std::string &key, const std::string &extension)
+    : mWriting (false)
+    {
+        Hash hash;
+        hash.add (key);
+
+        std::ostringstream path;
+        path << dir << '/' << std::hex << std::setw (16) << std::setfill ('0') << hash.get() << extension;
+        mPath = path.str();
+        mTmpPath = mPath + ".tmp";
+    }
+
+    CacheFile::~CacheFile()
+    {
+        if (mWriting)
+        {
+            boost::system::error_code ec;
+            boost::filesystem::remove (mTmpPath, ec);
+        }
+    }
+
+    const std::string& CacheFile::getTmpPath()
+    {
+        mWriting = true;
+        return mTmpPath;
+    }
+
+    void CacheFile::commit()
+    {
+        boost::filesystem::rename (mTmpPath, mPath);
+        mWriting = false;
+    }
+}
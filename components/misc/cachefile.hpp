@@ -0,0 +1,40 @@
+#ifndef MISC_CACHEFILE_H
+#define MISC_CACHEFILE_H
+
+#include <string>
+
+namespace Misc
+{
+    /// \brief A file in a cache directory, holding data derived from a key
+    ///
+    /// The key has to cover everything the data depends on. The file is
+    /// written under a temporary name and moved into place by commit(), so
+    /// that no other process ever sees it partially written.
+    class CacheFile
+    {
+        std::string mPath;
+        std::string mTmpPath;
+        bool mWriting;
+
+        // not implemented
+        CacheFile (const CacheFile&);
+        CacheFile& operator= (const CacheFile&);
+
+    public:
+        /// \param extension Including the dot
+        CacheFile (const std::string &dir, const std::string &key, const std::string &extension);
+
+        /// Removes the temporary file, unless it has been committed.
+        ~CacheFile();
+
+        const std::string& getPath() const { return mPath; }
+
+        /// Path to write the data to, before calling commit().
+        const std::string& getTmpPath();
+
+        /// Move the written data into place. Throws an exception on failure.
+        void commit();
+    };
+}
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef MISC_HASH_H
+#define MISC_HASH_H
+
+#include <string>
+
+#include <libs/platform/stdint.h>
+
+namespace Misc
+{
+    /// \brief 64 bit FNV-1a hash, fed one byte at a time
+    ///
+    /// Wide enough to name cache files by; hash tables just use the low bits
+    /// of get().
+    class Hash
+    {
+        uint64_t mValue;
+
+    public:
+        Hash() : mValue (14695981039346656037ULL) {}
+
+        void add (unsigned char c)
+        {
+            mValue ^= c;
+            mValue *= 1099511628211ULL;
+        }
+
+        void add (const std::string &str)
+        {
+            for (std::string::const_iterator it = str.begin(); it != str.end(); ++it)
+                add (static_cast<unsigned char> (*it));
+        }
+
+        uint64_t get() const { return mValue; }
+    };
+}
+
+#endif
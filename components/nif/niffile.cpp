@@ -34,85 +34,132 @@
 #include "controller.hpp"
 
 #include <iostream>
+#include <algorithm>
 
-//TODO: when threading is needed, enable these
-//#include <boost/mutex.hpp>
+#include <boost/thread/mutex.hpp>
 #include <boost/thread/locks.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+namespace
+{
+    /// Files are shared by their lower case name with '/' separators, as the
+    /// resource system doesn't care about either
+    std::string normalize (const std::string &name)
+    {
+        std::string normalized = Misc::StringUtils::lowerCase (name);
+        std::replace (normalized.begin(), normalized.end(), '\\', '/');
+        return normalized;
+    }
+}
 
 namespace Nif
 {
 
+/// Keeps one NIFFile per name alive as long as someone uses it. Files can be
+/// created from any thread; if several threads ask for a file at the same
+/// time, one parses it and the others wait for the result.
 class NIFFile::LoadedCache
 {
-    //TODO: enable this to make cache thread safe...
-    //typedef boost::mutex mutex;
-    
-    struct mutex
+    typedef boost::mutex mutex;
+    typedef boost::lock_guard <mutex> lock_guard;
+    typedef boost::unique_lock <mutex> unique_lock;
+
+    struct entry
     {
-        void lock () {};
-        void unlock () {}
+        boost::weak_ptr <NIFFile> mFile;
+
+        /// Some thread is parsing the file right now
+        bool mLoading;
+
+        entry () : mLoading (false) {}
     };
-    
-    typedef boost::lock_guard <mutex> lock_guard;
-    typedef std::map < std::string, boost::weak_ptr <NIFFile> > loaded_map;
+
+    typedef std::map < std::string, entry > loaded_map;
     typedef std::vector < boost::shared_ptr <NIFFile> > locked_files;
 
     static int sLockLevel;
     static mutex sProtector;
+    static boost::condition_variable sLoaded;
     static loaded_map sLoadedMap;
     static locked_files sLockedFiles;
 
 public:
 
-    static ptr create (const std::string &name)
+    static ptr create (const std::string &name, const Ogre::DataStreamPtr &stream)
     {
-        lock_guard _ (sProtector);
+        {
+            unique_lock lock (sProtector);
 
+            while (true)
+            {
+                entry &e = sLoadedMap [name];
+
+                // another thread is parsing it, wait for that
+                if (e.mLoading)
+                {
+                    sLoaded.wait (lock);
+                    continue;
+                }
+
+                // still alive, or not yet destroyed completely
+                ptr result = e.mFile.lock ();
+
+                if (result)
+                {
+                    // if we are locking the cache add an extra reference
+                    // to keep the file in memory
+                    if (sLockLevel > 0)
+                        sLockedFiles.push_back (result);
+
+                    return result;
+                }
+
+                // it doesn't exist currently, we are going to parse it
+                e.mLoading = true;
+                break;
+            }
+        }
+
+        // parse outside of the lock, so that other files can be loaded
+        // in the meantime
         ptr result;
 
-        // lookup the resource
-        loaded_map::iterator i = sLoadedMap.find (name);
+        try
+        {
+            result = boost::make_shared <NIFFile> (name, stream, psudo_private_modifier());
+        }
+        catch (...)
+        {
+            {
+                lock_guard _ (sProtector);
 
-        if (i == sLoadedMap.end ()) // it doesn't existing currently,
-        {                           // or hasn't in the very near past
+                // waiting threads retry, and report the error themselves
+                loaded_map::iterator i = sLoadedMap.find (name);
+                i->second.mLoading = false;
+                if (i->second.mFile.expired ())
+                    sLoadedMap.erase (i);
+            }
+            sLoaded.notify_all ();
+            throw;
+        }
 
-            // create it now, for smoother threading if needed, the
-            // loading should be performed outside of the sLoaderMap
-            // lock and an alternate mechanism should be used to
-            // synchronize threads competing to load the same resource
-            result = boost::make_shared <NIFFile> (name, psudo_private_modifier());
+        {
+            lock_guard _ (sProtector);
 
-            // if we are locking the cache add an extra reference
-            // to keep the file in memory
-            if (sLockLevel > 0)
-                sLockedFiles.push_back (result);
+            entry &e = sLoadedMap [name];
 
-            // stash a reference to the resource so that future
-            // calls can benefit
-            sLoadedMap [name] = boost::weak_ptr <NIFFile> (result);
-        }
-        else // it may (probably) still exists
-        {
-            // attempt to get the reference
-            result = i->second.lock ();
+            // we potentially overwrite an expired pointer here but the
+            // other thread performing the delete on the previous copy of
+            // this resource will detect it and make sure not to erase
+            // the new reference
+            e.mFile = result;
+            e.mLoading = false;
 
-            if (!result) // resource is in the process of being destroyed
-            {
-                // create a new instance, to replace the one that has
-                // begun the irreversible process of being destroyed
-                result = boost::make_shared <NIFFile> (name, psudo_private_modifier());
-
-                // respect the cache lock...
-                if (sLockLevel > 0)
-                    sLockedFiles.push_back (result);
-
-                // we potentially overwrite an expired pointer here
-                // but the other thread performing the delete on
-                // the previous copy of this resource will detect it
-                // and make sure not to erase the new reference
-                sLoadedMap [name] = boost::weak_ptr <NIFFile> (result);
-            }
+            // respect the cache lock...
+            if (sLockLevel > 0)
+                sLockedFiles.push_back (result);
         }
+        sLoaded.notify_all ();
 
         // we made it!
         return result;
@@ -124,14 +171,17 @@ public:
 
         loaded_map::iterator i = sLoadedMap.find (file->filename);
 
-        // its got to be in here, it just might not be us...
-        assert (i != sLoadedMap.end ());
+        // a failed parse erases the entry of an expired file, which
+        // may happen before its release gets here
+        if (i == sLoadedMap.end ())
+            return;
 
-        // if weak_ptr is still expired, this resource hasn't been recreated
-        // between the initiation of the final release due to destruction
-        // of the last shared pointer and this thread acquiring the lock on
+        // if weak_ptr is still expired and nobody is parsing the file
+        // again, this resource hasn't been recreated between the
+        // initiation of the final release due to destruction of the
+        // last shared pointer and this thread acquiring the lock on
         // the loader map
-        if (i->second.expired ())
+        if (!i->second.mLoading && i->second.mFile.expired ())
             sLoadedMap.erase (i);
     }
 
@@ -149,32 +199,37 @@ public:
         {
             lock_guard _ (sProtector);
 
-            if (--sLockLevel)
+            if (--sLockLevel == 0)
                 sLockedFiles.swap(resetList);
         }
 
-        // this not necessary, but makes it clear that the
-        // deletion of the locked cache entries is being done
-        // outside the protection of sProtector
+        // the locked files have to be released outside the protection
+        // of sProtector, as their destructors call release ()
         resetList.clear ();
     }
 };
 
 int NIFFile::LoadedCache::sLockLevel = 0;
 NIFFile::LoadedCache::mutex NIFFile::LoadedCache::sProtector;
+boost::condition_variable NIFFile::LoadedCache::sLoaded;
 NIFFile::LoadedCache::loaded_map NIFFile::LoadedCache::sLoadedMap;
 NIFFile::LoadedCache::locked_files NIFFile::LoadedCache::sLockedFiles;
 
-// these three calls are forwarded to the cache implementation...
+// these calls are forwarded to the cache implementation...
 void NIFFile::lockCache ()     { LoadedCache::lockCache (); }
 void NIFFile::unlockCache ()   { LoadedCache::unlockCache (); }
-NIFFile::ptr NIFFile::create (const std::string &name) { return LoadedCache::create  (name); }
+NIFFile::ptr NIFFile::create (const std::string &name) { return LoadedCache::create  (normalize (name), Ogre::DataStreamPtr()); }
+
+NIFFile::ptr NIFFile::create (const std::string &name, const Ogre::DataStreamPtr &stream)
+{
+    return LoadedCache::create (normalize (name), stream);
+}
 
 /// Open a NIF stream. The name is used for error messages.
-NIFFile::NIFFile(const std::string &name, psudo_private_modifier)
+NIFFile::NIFFile(const std::string &name, const Ogre::DataStreamPtr &stream, psudo_private_modifier)
     : filename(name)
 {
-    parse();
+    parse(stream);
 }
 
 NIFFile::~NIFFile()
@@ -286,9 +341,12 @@ RecordFactoryEntry const * lookupRecordFactory (char const * name)
    definitions in the record types.
  */
 
-void NIFFile::parse()
+void NIFFile::parse(Ogre::DataStreamPtr stream)
 {
-    NIFStream nif (this, Ogre::ResourceGroupManager::getSingleton().openResource(filename));
+    if (stream.isNull())
+        stream = Ogre::ResourceGroupManager::getSingleton().openResource(filename);
+
+    NIFStream nif (this, stream);
 
   // Check the header string
   std::string head = nif.getString(40);
@@ -69,8 +69,8 @@ class NIFFile
     /// Root list
     std::vector<Record*> roots;
 
-    /// Parse the file
-    void parse();
+    /// Parse the file from \a stream, or from Ogre's resource system if it is null
+    void parse(Ogre::DataStreamPtr stream);
 
     class LoadedCache;
     friend class LoadedCache;
@@ -98,10 +98,15 @@ public:
     typedef boost::shared_ptr <NIFFile> ptr;
 
     /// Open a NIF stream. The name is used for error messages.
-    NIFFile(const std::string &name, psudo_private_modifier);
+    NIFFile(const std::string &name, const Ogre::DataStreamPtr &stream, psudo_private_modifier);
     ~NIFFile();
 
+    /// Shared by name, regardless of case and of '/' or '\\' separators.
     static ptr create (const std::string &name);
+
+    /// Like create(name), but parses \a stream if the file isn't cached yet.
+    /// Doesn't touch Ogre's resource system, so it can be used from worker threads.
+    static ptr create (const std::string &name, const Ogre::DataStreamPtr &stream);
     static void lockCache ();
     static void unlockCache ();
 
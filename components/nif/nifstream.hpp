@@ -1,6 +1,9 @@
 #ifndef OPENMW_COMPONENTS_NIF_NIFSTREAM_HPP
 #define OPENMW_COMPONENTS_NIF_NIFSTREAM_HPP
 
+#include <algorithm>
+#include <cstring>
+
 namespace Nif
 {
 
@@ -11,38 +14,132 @@ class NIFStream {
     /// Input stream
     Ogre::DataStreamPtr inp;
 
-    uint8_t read_byte()
+    /// The whole file; points into the stream if it is already in memory,
+    /// into mBuffer otherwise
+    const uint8_t *mStart;
+    const uint8_t *mPos;
+    const uint8_t *mEnd;
+    std::vector<uint8_t> mBuffer;
+
+    /// Advance by \a size bytes and return the start of them, or 0 if the
+    /// file ends before (and the rest of the file is skipped, like a short read)
+    const uint8_t *take(size_t size)
     {
-        uint8_t byte;
-        if(inp->read(&byte, 1) != 1) return 0;
-        return byte;
+        if(size_t(mEnd - mPos) < size)
+        {
+            mPos = mEnd;
+            return 0;
+        }
+        const uint8_t *data = mPos;
+        mPos += size;
+        return data;
     }
-    uint16_t read_le16()
+
+    static uint16_t decode_le16(const uint8_t *buffer)
     {
-        uint8_t buffer[2];
-        if(inp->read(buffer, 2) != 2) return 0;
         return buffer[0] | (buffer[1]<<8);
     }
-    uint32_t read_le32()
+    static uint32_t decode_le32(const uint8_t *buffer)
     {
-        uint8_t buffer[4];
-        if(inp->read(buffer, 4) != 4) return 0;
         return buffer[0] | (buffer[1]<<8) | (buffer[2]<<16) | (buffer[3]<<24);
     }
-    float read_le32f()
+    static float decode_le32f(const uint8_t *buffer)
     {
         union {
             uint32_t i;
             float f;
-        } u = { read_le32() };
+        } u = { decode_le32(buffer) };
         return u.f;
     }
 
+    uint8_t read_byte()
+    {
+        const uint8_t *buffer = take(1);
+        if(!buffer) return 0;
+        return buffer[0];
+    }
+    uint16_t read_le16()
+    {
+        const uint8_t *buffer = take(2);
+        if(!buffer) return 0;
+        return decode_le16(buffer);
+    }
+    uint32_t read_le32()
+    {
+        const uint8_t *buffer = take(4);
+        if(!buffer) return 0;
+        return decode_le32(buffer);
+    }
+    float read_le32f()
+    {
+        const uint8_t *buffer = take(4);
+        if(!buffer) return 0;
+        return decode_le32f(buffer);
+    }
+
+    /// Read \a count floats into \a dest in one go. Floats past the end of
+    /// the file are 0, as with read_le32f().
+    void read_le32f_array(float *dest, size_t count)
+    {
+        size_t available = std::min(count, size_t(mEnd - mPos) / 4);
+        const uint8_t *buffer = mPos;
+        mPos = (available < count) ? mEnd : mPos + count*4;
+
+#ifdef BOOST_LITTLE_ENDIAN
+        std::memcpy(dest, buffer, available*4);
+#else
+        for(size_t i = 0;i < available;i++)
+            dest[i] = decode_le32f(buffer + i*4);
+#endif
+        std::fill(dest+available, dest+count, 0.0f);
+    }
+
+    /// Read \a count vectors, quaternions etc. of \a components floats each
+    template<typename T>
+    void read_le32f_array(std::vector<T> &vec, size_t count, size_t components)
+    {
+        vec.resize(count);
+        if(count == 0)
+            return;
+
+        // Ogre's math types are plain arrays of Reals
+        if(sizeof(T) == components*sizeof(float))
+        {
+            read_le32f_array(reinterpret_cast<float*>(&vec[0]), count*components);
+            return;
+        }
+
+        std::vector<float> a(count*components);
+        read_le32f_array(&a[0], a.size());
+        for(size_t i = 0;i < count;i++)
+            vec[i] = T(&a[i*components]);
+    }
+
 public:
 
     NIFFile * const file;
 
-    NIFStream (NIFFile * file, Ogre::DataStreamPtr inp): file (file), inp (inp) {}
+    NIFStream (NIFFile * file, Ogre::DataStreamPtr inp): inp (inp), file (file)
+    {
+        // Decode from memory instead of asking the stream for every field.
+        // Archive and prefetched files are memory streams already.
+        Ogre::MemoryDataStream *memory = dynamic_cast<Ogre::MemoryDataStream*>(inp.get());
+        if(memory)
+        {
+            mStart = mPos = memory->getPtr() + memory->tell();
+            mEnd = memory->getPtr() + memory->size();
+            return;
+        }
+
+        mBuffer.reserve(inp->size());
+        uint8_t chunk[65536];
+        size_t read;
+        while((read = inp->read(chunk, sizeof(chunk))) > 0)
+            mBuffer.insert(mBuffer.end(), chunk, chunk+read);
+
+        mStart = mPos = mBuffer.empty() ? 0 : &mBuffer[0];
+        mEnd = mPos + mBuffer.size();
+    }
 
     /*************************************************
                Parser functions
@@ -67,8 +164,13 @@ public:
         Value = GetHandler <T>::read (nif);
     }
 
-    void skip(size_t size) { inp->skip(size); }
-    void read (void * data, size_t size) { inp->read (data, size); }
+    void skip(size_t size) { mPos += std::min(size, size_t(mEnd - mPos)); }
+    void read (void * data, size_t size)
+    {
+        size = std::min(size, size_t(mEnd - mPos));
+        std::memcpy(data, mPos, size);
+        mPos += size;
+    }
 
     char getChar() { return read_byte(); }
     short getShort() { return read_le16(); }
@@ -125,12 +227,14 @@ public:
 
     std::string getString(size_t length)
     {
-        std::vector<char> str (length+1, 0);
+        const uint8_t *str = take(length);
 
-        if(inp->read(&str[0], length) != length)
+        if(!str)
             throw std::runtime_error ("string length in NIF file does not match");
 
-        return &str[0];
+        // Stop at the first null byte, like a C string
+        const uint8_t *end = std::find(str, str+length, 0);
+        return std::string(str, end);
     }
     std::string getString()
     {
@@ -141,38 +245,40 @@ public:
     void getShorts(std::vector<short> &vec, size_t size)
     {
         vec.resize(size);
-        for(size_t i = 0;i < vec.size();i++)
-            vec[i] = getShort();
+        size_t available = std::min(size, size_t(mEnd - mPos) / 2);
+        const uint8_t *buffer = mPos;
+        mPos = (available < size) ? mEnd : mPos + size*2;
+
+#ifdef BOOST_LITTLE_ENDIAN
+        if(available > 0)
+            std::memcpy(&vec[0], buffer, available*2);
+#else
+        for(size_t i = 0;i < available;i++)
+            vec[i] = decode_le16(buffer + i*2);
+#endif
+        std::fill(vec.begin()+available, vec.end(), 0);
     }
     void getFloats(std::vector<float> &vec, size_t size)
     {
         vec.resize(size);
-        for(size_t i = 0;i < vec.size();i++)
-            vec[i] = getFloat();
+        if(size > 0)
+            read_le32f_array(&vec[0], size);
     }
     void getVector2s(std::vector<Ogre::Vector2> &vec, size_t size)
     {
-        vec.resize(size);
-        for(size_t i = 0;i < vec.size();i++)
-            vec[i] = getVector2();
+        read_le32f_array(vec, size, 2);
     }
     void getVector3s(std::vector<Ogre::Vector3> &vec, size_t size)
     {
-        vec.resize(size);
-        for(size_t i = 0;i < vec.size();i++)
-            vec[i] = getVector3();
+        read_le32f_array(vec, size, 3);
     }
     void getVector4s(std::vector<Ogre::Vector4> &vec, size_t size)
     {
-        vec.resize(size);
-        for(size_t i = 0;i < vec.size();i++)
-            vec[i] = getVector4();
+        read_le32f_array(vec, size, 4);
     }
     void getQuaternions(std::vector<Ogre::Quaternion> &quat, size_t size)
     {
-        quat.resize(size);
-        for(size_t i = 0;i < quat.size();i++)
-            quat[i] = getQuaternion();
+        read_le32f_array(quat, size, 4);
     }
 };
 
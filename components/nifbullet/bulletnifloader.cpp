@@ -24,9 +24,17 @@ http://www.gnu.org/licenses/ .
 #include "bulletnifloader.hpp"
 
 #include <cstdio>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
 
+#include <boost/filesystem.hpp>
+#include <boost/scoped_ptr.hpp>
 
 #include <components/misc/stringops.hpp>
+#include <components/misc/cachefile.hpp>
+#include <components/files/constrainedfiledatastream.hpp>
 
 #include "../nif/niffile.hpp"
 #include "../nif/node.hpp"
@@ -53,16 +61,206 @@ struct TriangleMeshShape : public btBvhTriangleMeshShape
 {
     TriangleMeshShape(btStridingMeshInterface* meshInterface, bool useQuantizedAabbCompression)
         : btBvhTriangleMeshShape(meshInterface, useQuantizedAabbCompression)
+        , mCachedBvh(NULL)
     {
     }
 
+    // Use a BVH deserialized in place, in a buffer from btAlignedAlloc. The shape takes ownership of the buffer.
+    TriangleMeshShape(btStridingMeshInterface* meshInterface, btOptimizedBvh* cachedBvh)
+        : btBvhTriangleMeshShape(meshInterface, true, false)
+        , mCachedBvh(cachedBvh)
+    {
+        setOptimizedBvh(cachedBvh);
+    }
+
     virtual ~TriangleMeshShape()
     {
         delete getTriangleInfoMap();
         delete m_meshInterface;
+
+        // Bullet builds and owns a new BVH if the shape is scaled later, so this may not be the current one
+        if (mCachedBvh)
+        {
+            mCachedBvh->~btOptimizedBvh();
+            btAlignedFree(mCachedBvh);
+        }
     }
+
+    btOptimizedBvh* mCachedBvh;
+};
+
+std::string ManualBulletShapeLoader::sCachePath;
+
+// Increase when the conversion or the file format changes, to ignore shapes cached before
+static const int sShapeCacheVersion = 1;
+
+// Cached shapes are written in the native byte order and btScalar size. The cache directory is local to the
+// machine, and the btScalar size is part of the file name.
+static const char sShapeCacheMagic[4] = { 'O', 'M', 'W', 'S' };
+
+enum CachedShapeType
+{
+    CachedShape_None = 0,
+    CachedShape_Box = 1,
+    CachedShape_TriangleMesh = 2
 };
 
+namespace
+{
+    template<typename T>
+    void put(std::ostream &stream, const T &value)
+    {
+        stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    void putVector(std::ostream &stream, const btVector3 &v)
+    {
+        put(stream, v.x());
+        put(stream, v.y());
+        put(stream, v.z());
+    }
+
+    void putShape(std::ostream &stream, btCollisionShape *shape)
+    {
+        if (shape == NULL)
+        {
+            put<unsigned char>(stream, CachedShape_None);
+            return;
+        }
+
+        if (shape->getShapeType() == BOX_SHAPE_PROXYTYPE)
+        {
+            put<unsigned char>(stream, CachedShape_Box);
+            putVector(stream, static_cast<btBoxShape*>(shape)->getHalfExtentsWithMargin());
+            return;
+        }
+
+        TriangleMeshShape *meshShape = static_cast<TriangleMeshShape*>(shape);
+        put<unsigned char>(stream, CachedShape_TriangleMesh);
+
+        // Triangles in mesh order, which the triangle indices of the BVH refer to
+        const btStridingMeshInterface *mesh = meshShape->getMeshInterface();
+        const unsigned char *vertexbase;
+        const unsigned char *indexbase;
+        int numverts, stride, indexstride, numfaces;
+        PHY_ScalarType type, indicestype;
+        mesh->getLockedReadOnlyVertexIndexBase(&vertexbase, numverts, type, stride,
+                                               &indexbase, indexstride, numfaces, indicestype);
+
+        put<unsigned int>(stream, numfaces);
+        for (int i = 0; i < numfaces; ++i)
+        {
+            for (int j = 0; j < 3; ++j)
+            {
+                int index;
+                if (indicestype == PHY_SHORT)
+                    index = reinterpret_cast<const unsigned short*>(indexbase + i*indexstride)[j];
+                else
+                    index = reinterpret_cast<const unsigned int*>(indexbase + i*indexstride)[j];
+
+                const btScalar *vertex = reinterpret_cast<const btScalar*>(vertexbase + index*stride);
+                put(stream, vertex[0]);
+                put(stream, vertex[1]);
+                put(stream, vertex[2]);
+            }
+        }
+        mesh->unLockReadOnlyVertexBase(0);
+
+        const btOptimizedBvh *bvh = meshShape->getOptimizedBvh();
+        unsigned int size = bvh->calculateSerializeBufferSize();
+        void *buffer = btAlignedAlloc(size, 16);
+        bvh->serialize(buffer, size, false);
+
+        put(stream, size);
+        stream.write(static_cast<const char*>(buffer), size);
+        btAlignedFree(buffer);
+    }
+
+    class ShapeReader
+    {
+        Ogre::DataStreamPtr mStream;
+
+    public:
+        ShapeReader(const Ogre::DataStreamPtr &stream) : mStream(stream) {}
+
+        void read(void *data, size_t size)
+        {
+            if (mStream->read(data, size) != size)
+                throw std::runtime_error("unexpected end of file");
+        }
+
+        template<typename T>
+        T get()
+        {
+            T value;
+            read(&value, sizeof(T));
+            return value;
+        }
+
+        btVector3 getVector()
+        {
+            btScalar x = get<btScalar>();
+            btScalar y = get<btScalar>();
+            btScalar z = get<btScalar>();
+            return btVector3(x, y, z);
+        }
+
+        size_t remaining() const
+        {
+            return mStream->size() - mStream->tell();
+        }
+
+        /// Returns NULL for CachedShape_None
+        btCollisionShape *getShape()
+        {
+            unsigned char type = get<unsigned char>();
+
+            if (type == CachedShape_None)
+                return NULL;
+            if (type == CachedShape_Box)
+                return new btBoxShape(getVector());
+            if (type != CachedShape_TriangleMesh)
+                throw std::runtime_error("unknown shape type");
+
+            unsigned int numfaces = get<unsigned int>();
+            if (numfaces > remaining() / (9 * sizeof(btScalar)))
+                throw std::runtime_error("unexpected end of file");
+
+            btTriangleMesh *mesh = new btTriangleMesh();
+            void *buffer = NULL;
+            try
+            {
+                for (unsigned int i = 0; i < numfaces; ++i)
+                {
+                    btVector3 b1 = getVector();
+                    btVector3 b2 = getVector();
+                    btVector3 b3 = getVector();
+                    mesh->addTriangle(b1, b2, b3);
+                }
+
+                unsigned int size = get<unsigned int>();
+                if (size > remaining())
+                    throw std::runtime_error("unexpected end of file");
+
+                buffer = btAlignedAlloc(size, 16);
+                read(buffer, size);
+
+                btOptimizedBvh *bvh = btOptimizedBvh::deSerializeInPlace(buffer, size, false);
+                if (bvh == NULL)
+                    throw std::runtime_error("invalid BVH");
+
+                return new TriangleMeshShape(mesh, bvh);
+            }
+            catch (...)
+            {
+                btAlignedFree(buffer);
+                delete mesh;
+                throw;
+            }
+        }
+    };
+}
+
 ManualBulletShapeLoader::~ManualBulletShapeLoader()
 {
 }
@@ -83,7 +281,14 @@ void ManualBulletShapeLoader::loadResource(Ogre::Resource *resource)
     mShape->mBoxRotation = Ogre::Quaternion::IDENTITY;
     mHasShape = false;
 
-    btTriangleMesh* mesh1 = new btTriangleMesh();
+    // The cache doesn't need the NIF, so look there before parsing it
+    boost::scoped_ptr<Misc::CacheFile> cacheFile;
+    if (!sCachePath.empty())
+    {
+        cacheFile.reset(new Misc::CacheFile(sCachePath, getCacheKey(), ".bullet"));
+        if (loadCachedShape(cacheFile->getPath()))
+            return;
+    }
 
     // Load the NIF. TODO: Wrap this in a try-catch block once we're out
     // of the early stages of development. Right now we WANT to catch
@@ -111,6 +316,7 @@ void ManualBulletShapeLoader::loadResource(Ogre::Resource *resource)
     mShape->mHasCollisionNode = hasRootCollisionNode(node);
 
     //do a first pass
+    btTriangleMesh* mesh1 = new btTriangleMesh();
     handleNode(mesh1, node,0,false,false,false);
 
     if(mBoundingBox != NULL)
@@ -148,6 +354,99 @@ void ManualBulletShapeLoader::loadResource(Ogre::Resource *resource)
     }
     else
         delete mesh2;
+
+    if (cacheFile)
+        saveCachedShape(*cacheFile);
+}
+
+std::string ManualBulletShapeLoader::getCacheKey() const
+{
+    // The NIF file is identified by its size and modification time, which is
+    // much cheaper than reading it again
+    const std::string name = mResourceName.substr(0, mResourceName.length()-7);
+    const std::string &group = mShape->getGroup();
+    Ogre::ResourceGroupManager &resMgr = Ogre::ResourceGroupManager::getSingleton();
+    Ogre::DataStreamPtr stream = resMgr.openResource(name, group);
+
+    // The shape doesn't depend on the scale suffix of the resource name, so all
+    // scales of a NIF file share one cache file
+    std::ostringstream key;
+    key << Misc::StringUtils::lowerCase(name) << '\0'
+        << stream->size() << '\0' << resMgr.resourceModifiedTime(group, name) << '\0'
+        << BT_BULLET_VERSION << '\0'
+        << sizeof(btScalar) << '\0'
+        << sShapeCacheVersion;
+    return key.str();
+}
+
+bool ManualBulletShapeLoader::loadCachedShape(const std::string &file)
+{
+    if (!boost::filesystem::exists(file))
+        return false;
+
+    btCollisionShape *collisionShape = NULL;
+    btCollisionShape *raycastingShape = NULL;
+    try
+    {
+        ShapeReader reader(openConstrainedFileDataStream(file.c_str()));
+
+        char magic[sizeof(sShapeCacheMagic)];
+        reader.read(magic, sizeof(magic));
+        if (!std::equal(magic, magic + sizeof(magic), sShapeCacheMagic))
+            throw std::runtime_error("not a shape cache file");
+
+        mShape->mHasCollisionNode = reader.get<unsigned char>() != 0;
+        mShape->mCollide = reader.get<unsigned char>() != 0;
+        reader.read(mShape->mBoxTranslation.ptr(), 3*sizeof(Ogre::Real));
+        reader.read(mShape->mBoxRotation.ptr(), 4*sizeof(Ogre::Real));
+
+        collisionShape = reader.getShape();
+        raycastingShape = reader.getShape();
+    }
+    catch (std::exception &e)
+    {
+        warn("Failed to load cached shape " + file + " for " + mResourceName + ": " + e.what());
+
+        delete collisionShape;
+        mShape->mHasCollisionNode = false;
+        mShape->mCollide = false;
+        mShape->mBoxTranslation = Ogre::Vector3(0,0,0);
+        mShape->mBoxRotation = Ogre::Quaternion::IDENTITY;
+        return false;
+    }
+
+    mShape->mCollisionShape = collisionShape;
+    mShape->mRaycastingShape = raycastingShape;
+    return true;
+}
+
+void ManualBulletShapeLoader::saveCachedShape(Misc::CacheFile &file)
+{
+    try
+    {
+        {
+            std::ofstream stream(file.getTmpPath().c_str(), std::ios::binary);
+
+            stream.write(sShapeCacheMagic, sizeof(sShapeCacheMagic));
+            put<unsigned char>(stream, mShape->mHasCollisionNode);
+            put<unsigned char>(stream, mShape->mCollide);
+            stream.write(reinterpret_cast<const char*>(mShape->mBoxTranslation.ptr()), 3*sizeof(Ogre::Real));
+            stream.write(reinterpret_cast<const char*>(mShape->mBoxRotation.ptr()), 4*sizeof(Ogre::Real));
+
+            putShape(stream, mShape->mCollisionShape);
+            putShape(stream, mShape->mRaycastingShape);
+
+            stream.close();
+            if (stream.fail())
+                throw std::runtime_error("write error");
+        }
+
+        file.commit();
+    }
+    catch (std::exception &e)
+    {
+        warn("Failed to cache shape " + mResourceName + " in " + file.getPath() + ": " + e.what());
+    }
 }
 
 bool ManualBulletShapeLoader::hasRootCollisionNode(Nif::Node const * node)
@@ -304,4 +603,9 @@ void ManualBulletShapeLoader::load(const std::string &name,const std::string &gr
     OEngine::Physic::BulletShapeManager::getSingleton().create(name,group,true,this);
 }
 
+void ManualBulletShapeLoader::setCachePath(const std::string &path)
+{
+    sCachePath = path;
+}
+
 } // namespace NifBullet
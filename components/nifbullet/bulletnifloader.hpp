@@ -36,11 +36,17 @@
 
 namespace Nif
 {
+    class NIFFile;
     class Node;
     class Transformation;
     class NiTriShape;
 }
 
+namespace Misc
+{
+    class CacheFile;
+}
+
 namespace NifBullet
 {
 
@@ -82,6 +88,12 @@ public:
     */
     void load(const std::string &name,const std::string &group);
 
+    /**
+    *Keep the collision shapes, including their BVH, in \a path and load them from there as long as the NIF file stays the same.
+    *An empty path disables the cache.
+    */
+    static void setCachePath(const std::string &path);
+
 private:
     btVector3 getbtVector(Ogre::Vector3 const &v);
 
@@ -100,6 +112,20 @@ private:
     */
     void handleNiTriShape(btTriangleMesh* mesh, const Nif::NiTriShape *shape, int flags, const Ogre::Matrix4 &transform, bool raycasting);
 
+    /**
+    *Everything the current shape depends on, to find it in the shape cache.
+    */
+    std::string getCacheKey() const;
+
+    /**
+    *Load the current shape from the shape cache. Returns false (and leaves the shape empty) if it isn't there.
+    */
+    bool loadCachedShape(const std::string &file);
+
+    void saveCachedShape(Misc::CacheFile &file);
+
+    static std::string sCachePath;
+
     std::string mResourceName;
 
     OEngine::Physic::BulletShape* mShape;//current shape
@@ -0,0 +1,161 @@
+#include "keyframes.hpp"
+
+#include <cmath>
+#include <algorithm>
+
+#include <components/nif/data.hpp>
+
+namespace NifOgre
+{
+
+KeyframeTrack::TrackMap KeyframeTrack::sTracks;
+
+template<typename T>
+template<typename Key>
+void KeyframeTrack::Channel<T>::setTimes(const std::vector<Key> &keys)
+{
+    mTimeDeltas.resize(keys.size());
+    if(keys.empty())
+        return;
+
+    mStartTime = keys.front().mTime;
+
+    float maxGap = 0.0f;
+    for(size_t i = 1;i < keys.size();i++)
+        maxGap = std::max(maxGap, keys[i].mTime - keys[i-1].mTime);
+
+    // The largest gap still fits into a delta after rounding
+    mTimeStep = (maxGap > 0.0f) ? maxGap / 65534.0f : 1.0f;
+
+    // Round the time of each key, not the gaps, so that errors don't add up
+    uint32_t last = 0;
+    mTimeDeltas[0] = 0;
+    for(size_t i = 1;i < keys.size();i++)
+    {
+        double ticks = std::floor((double(keys[i].mTime) - mStartTime) / mTimeStep + 0.5);
+        uint32_t tick = static_cast<uint32_t>(std::max(ticks, 0.0));
+        tick = std::min(std::max(tick, last), last + 65535);
+        mTimeDeltas[i] = static_cast<uint16_t>(tick - last);
+        last = tick;
+    }
+}
+
+template<typename T>
+size_t KeyframeTrack::Channel<T>::find(float time, float &weight) const
+{
+    weight = 1.0f;
+
+    // In double precision, since long tracks have more ticks than a float can count
+    double tick = (double(time) - mStartTime) / mTimeStep;
+    if(tick <= 0.0)
+        return 0;
+
+    uint32_t last = 0;
+    for(size_t i = 1;i < mTimeDeltas.size();i++)
+    {
+        uint32_t next = last + mTimeDeltas[i];
+        if(next >= tick)
+        {
+            weight = static_cast<float>((tick - last) / mTimeDeltas[i]);
+            return i;
+        }
+        last = next;
+    }
+    return mTimeDeltas.size()-1;
+}
+
+
+KeyframeTrack::QuantizedQuaternion KeyframeTrack::quantize(const Ogre::Quaternion &q)
+{
+    Ogre::Quaternion n(q);
+    n.normalise();
+
+    QuantizedQuaternion result;
+    result.w = static_cast<int16_t>(std::floor(n.w * 32767.0f + 0.5f));
+    result.x = static_cast<int16_t>(std::floor(n.x * 32767.0f + 0.5f));
+    result.y = static_cast<int16_t>(std::floor(n.y * 32767.0f + 0.5f));
+    result.z = static_cast<int16_t>(std::floor(n.z * 32767.0f + 0.5f));
+    return result;
+}
+
+Ogre::Quaternion KeyframeTrack::dequantize(const QuantizedQuaternion &q)
+{
+    return Ogre::Quaternion(q.w / 32767.0f, q.x / 32767.0f, q.y / 32767.0f, q.z / 32767.0f);
+}
+
+
+KeyframeTrack::KeyframeTrack(const Nif::NiKeyframeData *data)
+{
+    const Nif::QuaternionKeyList::VecType &rotations = data->mRotations.mKeys;
+    mRotations.setTimes(rotations);
+    mRotations.mValues.reserve(rotations.size());
+    for(size_t i = 0;i < rotations.size();i++)
+        mRotations.mValues.push_back(quantize(rotations[i].mValue));
+
+    const Nif::Vector3KeyList::VecType &translations = data->mTranslations.mKeys;
+    mTranslations.setTimes(translations);
+    mTranslations.mValues.reserve(translations.size());
+    for(size_t i = 0;i < translations.size();i++)
+        mTranslations.mValues.push_back(translations[i].mValue);
+
+    const Nif::FloatKeyList::VecType &scales = data->mScales.mKeys;
+    mScales.setTimes(scales);
+    mScales.mValues.reserve(scales.size());
+    for(size_t i = 0;i < scales.size();i++)
+        mScales.mValues.push_back(scales[i].mValue);
+}
+
+KeyframeTrackPtr KeyframeTrack::get(const std::string &name, const Nif::NiKeyframeData *data)
+{
+    boost::weak_ptr<const KeyframeTrack> &entry = sTracks[std::make_pair(name, data->recIndex)];
+
+    KeyframeTrackPtr track = entry.lock();
+    if(!track)
+    {
+        track.reset(new KeyframeTrack(data));
+        entry = track;
+    }
+    return track;
+}
+
+
+Ogre::Quaternion KeyframeTrack::getRotation(float time) const
+{
+    float weight;
+    size_t i = mRotations.find(time, weight);
+
+    if(i == 0 || weight >= 1.0f)
+    {
+        Ogre::Quaternion q = dequantize(mRotations.mValues[i]);
+        q.normalise();
+        return q;
+    }
+    return Ogre::Quaternion::nlerp(weight, dequantize(mRotations.mValues[i-1]),
+                                           dequantize(mRotations.mValues[i]));
+}
+
+Ogre::Vector3 KeyframeTrack::getTranslation(float time) const
+{
+    float weight;
+    size_t i = mTranslations.find(time, weight);
+
+    if(i == 0 || weight >= 1.0f)
+        return mTranslations.mValues[i];
+
+    const Ogre::Vector3 &last = mTranslations.mValues[i-1];
+    return last + ((mTranslations.mValues[i] - last)*weight);
+}
+
+float KeyframeTrack::getScale(float time) const
+{
+    float weight;
+    size_t i = mScales.find(time, weight);
+
+    if(i == 0 || weight >= 1.0f)
+        return mScales.mValues[i];
+
+    float last = mScales.mValues[i-1];
+    return last + ((mScales.mValues[i] - last)*weight);
+}
+
+}
@@ -0,0 +1,88 @@
+#ifndef COMPONENTS_NIFOGRE_KEYFRAMES_HPP
+#define COMPONENTS_NIFOGRE_KEYFRAMES_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+
+#include <OgreVector3.h>
+#include <OgreQuaternion.h>
+
+#include <libs/platform/stdint.h>
+
+namespace Nif
+{
+    class NiKeyframeData;
+}
+
+namespace NifOgre
+{
+
+class KeyframeTrack;
+typedef boost::shared_ptr<const KeyframeTrack> KeyframeTrackPtr;
+
+/** Compact copy of the keys of a NiKeyframeData record, shared by all
+ * controllers animating with it. Only what linear interpolation needs is
+ * kept: key times as 16 bit deltas and rotations as 16 bit quaternion
+ * components, instead of full keys with the tangents and TBC parameters.
+ */
+class KeyframeTrack
+{
+    template<typename T>
+    struct Channel
+    {
+        float mStartTime;
+        // Seconds per tick
+        float mTimeStep;
+        // Ticks since the key before, 0 for the first key
+        std::vector<uint16_t> mTimeDeltas;
+        std::vector<T> mValues;
+
+        Channel() : mStartTime(0.0f), mTimeStep(1.0f) {}
+
+        // Set the key times from a list of Nif keys
+        template<typename Key>
+        void setTimes(const std::vector<Key> &keys);
+
+        // Index of the first key not before \a time, and the weight of that key
+        // against the one before it. The weight is 1 outside of the keys.
+        size_t find(float time, float &weight) const;
+    };
+
+    struct QuantizedQuaternion
+    {
+        int16_t w, x, y, z;
+    };
+
+    Channel<QuantizedQuaternion> mRotations;
+    Channel<Ogre::Vector3> mTranslations;
+    Channel<float> mScales;
+
+    static QuantizedQuaternion quantize(const Ogre::Quaternion &q);
+    static Ogre::Quaternion dequantize(const QuantizedQuaternion &q);
+
+    typedef std::map<std::pair<std::string, size_t>, boost::weak_ptr<const KeyframeTrack> > TrackMap;
+    static TrackMap sTracks;
+
+    KeyframeTrack(const Nif::NiKeyframeData *data);
+
+public:
+    /// Get the track of \a data, a record of the NIF file \a name. The track is
+    /// created once and shared while anything uses it. Not thread safe.
+    static KeyframeTrackPtr get(const std::string &name, const Nif::NiKeyframeData *data);
+
+    bool hasRotations() const { return !mRotations.mValues.empty(); }
+    bool hasTranslations() const { return !mTranslations.mValues.empty(); }
+    bool hasScales() const { return !mScales.mValues.empty(); }
+
+    Ogre::Quaternion getRotation(float time) const;
+    Ogre::Vector3 getTranslation(float time) const;
+    float getScale(float time) const;
+};
+
+}
+
+#endif
@@ -1,6 +1,10 @@
 #include "mesh.hpp"
 
 #include <limits>
+#include <sstream>
+
+#include <boost/filesystem.hpp>
+#include <boost/scoped_ptr.hpp>
 
 #include <OgreMeshManager.h>
 #include <OgreMesh.h>
@@ -11,9 +15,16 @@
 #include <OgreSkeletonManager.h>
 #include <OgreRenderSystem.h>
 #include <OgreRoot.h>
+#include <OgreMeshSerializer.h>
+
+#if OGRE_VERSION >= (1 << 16 | 9 << 8 | 0)
+#include <OgreProgressiveMeshGenerator.h>
+#endif
 
 #include <components/nif/node.hpp>
 #include <components/misc/stringops.hpp>
+#include <components/misc/cachefile.hpp>
+#include <components/files/constrainedfiledatastream.hpp>
 
 #include "material.hpp"
 
@@ -106,6 +117,16 @@ public:
 
 
 NIFMeshLoader::LoaderMap NIFMeshLoader::sLoaders;
+std::string NIFMeshLoader::sCachePath;
+
+int NIFMeshLoader::sLodLevels = 0;
+float NIFMeshLoader::sLodDistance = 0.0f;
+
+// Increase when the conversion changes, to ignore meshes cached before
+static const int sMeshCacheVersion = 1;
+
+// Meshes with fewer triangles are not worth reducing
+static const size_t sMinLodTriangles = 128;
 
 void NIFMeshLoader::createSubMesh(Ogre::Mesh *mesh, const Nif::NiTriShape *shape)
 {
@@ -310,20 +331,8 @@ void NIFMeshLoader::createSubMesh(Ogre::Mesh *mesh, const Nif::NiTriShape *shape
         }
     }
 
-    const Nif::NiTexturingProperty *texprop = NULL;
-    const Nif::NiMaterialProperty *matprop = NULL;
-    const Nif::NiAlphaProperty *alphaprop = NULL;
-    const Nif::NiVertexColorProperty *vertprop = NULL;
-    const Nif::NiZBufferProperty *zprop = NULL;
-    const Nif::NiSpecularProperty *specprop = NULL;
-    const Nif::NiWireframeProperty *wireprop = NULL;
     bool needTangents = false;
-
-    shape->getProperties(texprop, matprop, alphaprop, vertprop, zprop, specprop, wireprop);
-    std::string matname = NIFMaterialLoader::getMaterial(data, mesh->getName(), mGroup,
-                                                         texprop, matprop, alphaprop,
-                                                         vertprop, zprop, specprop,
-                                                         wireprop, needTangents);
+    std::string matname = createMaterial(mesh, shape, needTangents);
     if(matname.length() > 0)
         sub->setMaterialName(matname);
 
@@ -370,6 +379,130 @@ void NIFMeshLoader::createSubMesh(Ogre::Mesh *mesh, const Nif::NiTriShape *shape
     }
 }
 
+std::string NIFMeshLoader::createMaterial(Ogre::Mesh *mesh, const Nif::NiTriShape *shape, bool &needTangents)
+{
+    const Nif::NiTexturingProperty *texprop = NULL;
+    const Nif::NiMaterialProperty *matprop = NULL;
+    const Nif::NiAlphaProperty *alphaprop = NULL;
+    const Nif::NiVertexColorProperty *vertprop = NULL;
+    const Nif::NiZBufferProperty *zprop = NULL;
+    const Nif::NiSpecularProperty *specprop = NULL;
+    const Nif::NiWireframeProperty *wireprop = NULL;
+
+    shape->getProperties(texprop, matprop, alphaprop, vertprop, zprop, specprop, wireprop);
+    return NIFMaterialLoader::getMaterial(shape->data.getPtr(), mesh->getName(), mGroup,
+                                          texprop, matprop, alphaprop,
+                                          vertprop, zprop, specprop,
+                                          wireprop, needTangents);
+}
+
+
+std::string NIFMeshLoader::getCacheKey(const Ogre::Mesh *mesh) const
+{
+    // The NIF file is identified by its size and modification time, which is
+    // much cheaper than reading it again
+    Ogre::ResourceGroupManager &resMgr = Ogre::ResourceGroupManager::getSingleton();
+    Ogre::DataStreamPtr stream = resMgr.openResource(mName, mGroup);
+
+    // The mesh name covers the NIF file and the shape, the render system
+    // decides the vertex colour format, and the levels of detail are part of
+    // the cached mesh
+    std::ostringstream key;
+    key << mesh->getName() << '\0'
+        << stream->size() << '\0' << resMgr.resourceModifiedTime(mGroup, mName) << '\0'
+        << Ogre::Root::getSingleton().getRenderSystem()->getName() << '\0'
+        << sLodLevels << '\0' << sLodDistance << '\0'
+        << sMeshCacheVersion;
+    return key.str();
+}
+
+
+bool NIFMeshLoader::loadCachedMesh(Ogre::Mesh *mesh, const Nif::NiTriShape *shape, const std::string &file)
+{
+    if(!boost::filesystem::exists(file))
+        return false;
+
+    // Same buffer usage as createSubMesh()
+    if(!shape->skin.empty())
+        mesh->setVertexBufferPolicy(Ogre::HardwareBuffer::HBU_DYNAMIC_WRITE_ONLY, true);
+
+    try
+    {
+        Ogre::DataStreamPtr stream = openConstrainedFileDataStream(file.c_str());
+        Ogre::MeshSerializer().importMesh(stream, mesh);
+    }
+    catch(std::exception &e)
+    {
+        warn("Failed to load cached mesh "+file+" for "+mesh->getName()+": "+e.what());
+
+        while(mesh->getNumSubMeshes() > 0)
+            mesh->destroySubMesh(0);
+        mesh->removeAllAnimations();
+        mesh->removeAllPoses();
+        mesh->removeLodLevels();
+        mesh->setVertexBufferPolicy(Ogre::HardwareBuffer::HBU_STATIC_WRITE_ONLY, true);
+        return false;
+    }
+
+    // Materials are not part of the cached mesh
+    bool needTangents = false;
+    std::string matname = createMaterial(mesh, shape, needTangents);
+    if(matname.length() > 0 && mesh->getNumSubMeshes() > 0)
+        mesh->getSubMesh(0)->setMaterialName(matname);
+
+    return true;
+}
+
+
+void NIFMeshLoader::saveCachedMesh(const Ogre::Mesh *mesh, Misc::CacheFile &file)
+{
+    try
+    {
+        Ogre::MeshSerializer().exportMesh(mesh, file.getTmpPath());
+        file.commit();
+    }
+    catch(std::exception &e)
+    {
+        warn("Failed to cache mesh "+mesh->getName()+" in "+file.getPath()+": "+e.what());
+    }
+}
+
+
+void NIFMeshLoader::generateLodLevels(Ogre::Mesh *mesh, const Nif::NiTriShape *shape)
+{
+    if(sLodLevels <= 0)
+        return;
+
+    // Skinned and morphing meshes change their vertices at run time
+    if(!shape->skin.empty() || mesh->getPoseCount() > 0)
+        return;
+
+    if(shape->data.getPtr()->triangles.size()/3 < sMinLodTriangles)
+        return;
+
+#if OGRE_VERSION >= (1 << 16 | 9 << 8 | 0)
+    Ogre::MeshPtr meshPtr = Ogre::MeshManager::getSingleton().getByName(mesh->getName(), mesh->getGroup());
+    Ogre::LodConfig config(meshPtr);
+
+    // Proportions of the full mesh
+    float reduction = 1.0f;
+    for(int i = 1;i <= sLodLevels;i++)
+    {
+        reduction *= 0.5f;
+        config.createGeneratedLodLevel(sLodDistance*i, 1.0f-reduction);
+    }
+
+    Ogre::ProgressiveMeshGenerator().generateLodLevels(config);
+#else
+    Ogre::Mesh::LodValueList distances;
+    for(int i = 1;i <= sLodLevels;i++)
+        distances.push_back(sLodDistance*i);
+
+    // Proportion of the previous level
+    mesh->generateLodLevels(distances, Ogre::ProgressiveMesh::VRQ_PROPORTIONAL, 0.5f);
+#endif
+}
+
 
 NIFMeshLoader::NIFMeshLoader(const std::string &name, const std::string &group, size_t idx)
   : mName(name), mGroup(group), mShapeIndex(idx)
@@ -390,8 +523,21 @@ void NIFMeshLoader::loadResource(Ogre::Resource *resource)
         return;
     }
 
-    const Nif::Record *record = nif->getRecord(mShapeIndex);
-    createSubMesh(mesh, dynamic_cast<const Nif::NiTriShape*>(record));
+    const Nif::NiTriShape *shape = dynamic_cast<const Nif::NiTriShape*>(nif->getRecord(mShapeIndex));
+
+    boost::scoped_ptr<Misc::CacheFile> cacheFile;
+    if(!sCachePath.empty())
+    {
+        cacheFile.reset(new Misc::CacheFile(sCachePath, getCacheKey(mesh), ".mesh"));
+        if(loadCachedMesh(mesh, shape, cacheFile->getPath()))
+            return;
+    }
+
+    createSubMesh(mesh, shape);
+    generateLodLevels(mesh, shape);
+
+    if(cacheFile)
+        saveCachedMesh(mesh, *cacheFile);
 }
 
 
@@ -405,4 +551,15 @@ void NIFMeshLoader::createMesh(const std::string &name, const std::string &fulln
     mesh->setAutoBuildEdgeLists(false);
 }
 
+void NIFMeshLoader::setCachePath(const std::string &path)
+{
+    sCachePath = path;
+}
+
+void NIFMeshLoader::setLodLevels(int levels, float distance)
+{
+    sLodLevels = levels;
+    sLodDistance = distance;
+}
+
 }
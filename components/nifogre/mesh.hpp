@@ -10,9 +10,15 @@
 
 namespace Nif
 {
+    class NIFFile;
     class NiTriShape;
 }
 
+namespace Misc
+{
+    class CacheFile;
+}
+
 namespace NifOgre
 {
 
@@ -39,15 +45,45 @@ class NIFMeshLoader : Ogre::ManualResourceLoader
     // Convert NiTriShape to Ogre::SubMesh
     void createSubMesh(Ogre::Mesh *mesh, const Nif::NiTriShape *shape);
 
+    // Create the material of the shape and return its name
+    std::string createMaterial(Ogre::Mesh *mesh, const Nif::NiTriShape *shape, bool &needTangents);
+
+    // Everything the converted shape depends on, to find it in the mesh cache
+    std::string getCacheKey(const Ogre::Mesh *mesh) const;
+
+    // Load the converted shape from the mesh cache. Returns false (and leaves
+    // the mesh empty) if it isn't there.
+    bool loadCachedMesh(Ogre::Mesh *mesh, const Nif::NiTriShape *shape, const std::string &file);
+
+    void saveCachedMesh(const Ogre::Mesh *mesh, Misc::CacheFile &file);
+
+    // Add reduced levels of detail to the mesh, if enabled and worthwhile
+    void generateLodLevels(Ogre::Mesh *mesh, const Nif::NiTriShape *shape);
+
     typedef std::map<std::string,NIFMeshLoader> LoaderMap;
     static LoaderMap sLoaders;
 
+    static std::string sCachePath;
+
+    static int sLodLevels;
+    static float sLodDistance;
+
     NIFMeshLoader(const std::string &name, const std::string &group, size_t idx);
 
     virtual void loadResource(Ogre::Resource *resource);
 
 public:
     static void createMesh(const std::string &name, const std::string &fullname, const std::string &group, size_t idx);
+
+    /// Keep converted meshes in \a path, in Ogre's binary mesh format, and load
+    /// them from there as long as the NIF file stays the same. An empty path
+    /// disables the cache.
+    static void setCachePath(const std::string &path);
+
+    /// Generate \a levels levels of detail for each static mesh, each with half
+    /// the vertices of the one before, starting every \a distance units.
+    /// 0 levels disables them.
+    static void setLodLevels(int levels, float distance);
 };
 
 }
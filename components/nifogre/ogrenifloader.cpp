@@ -48,10 +48,14 @@
 #include "material.hpp"
 #include "mesh.hpp"
 #include "controller.hpp"
+#include "keyframes.hpp"
 
 namespace NifOgre
 {
 
+// Use shared KeyframeTracks instead of copying the keys into each controller
+static bool sCompressKeyframes = true;
+
 Ogre::MaterialPtr MaterialControllerManager::getWritableMaterial(Ogre::MovableObject *movable)
 {
     if (mClonedMaterials.find(movable) != mClonedMaterials.end())
@@ -440,6 +444,63 @@ public:
         }
     };
 
+    class SharedValue : public NodeTargetValue<Ogre::Real>
+    {
+    private:
+        KeyframeTrackPtr mTrack;
+
+    public:
+        SharedValue(Ogre::Node *target, const KeyframeTrackPtr &track)
+          : NodeTargetValue<Ogre::Real>(target)
+          , mTrack(track)
+        { }
+
+        virtual Ogre::Quaternion getRotation(float time) const
+        {
+            if(mTrack->hasRotations())
+                return mTrack->getRotation(time);
+            return mNode->getOrientation();
+        }
+
+        virtual Ogre::Vector3 getTranslation(float time) const
+        {
+            if(mTrack->hasTranslations())
+                return mTrack->getTranslation(time);
+            return mNode->getPosition();
+        }
+
+        virtual Ogre::Vector3 getScale(float time) const
+        {
+            if(mTrack->hasScales())
+                return Ogre::Vector3(mTrack->getScale(time));
+            return mNode->getScale();
+        }
+
+        virtual Ogre::Real getValue() const
+        {
+            // Should not be called
+            return 0.0f;
+        }
+
+        virtual void setValue(Ogre::Real time)
+        {
+            if(mTrack->hasRotations())
+                mNode->setOrientation(mTrack->getRotation(time));
+            if(mTrack->hasTranslations())
+                mNode->setPosition(mTrack->getTranslation(time));
+            if(mTrack->hasScales())
+                mNode->setScale(Ogre::Vector3(mTrack->getScale(time)));
+        }
+    };
+
+    static Ogre::ControllerValueRealPtr createValue(Ogre::Node *target, const std::string &name,
+                                                    const Nif::NiKeyframeData *data)
+    {
+        if(sCompressKeyframes)
+            return Ogre::ControllerValueRealPtr(OGRE_NEW SharedValue(target, KeyframeTrack::get(name, data)));
+        return Ogre::ControllerValueRealPtr(OGRE_NEW Value(target, data));
+    }
+
     typedef DefaultFunction Function;
 };
 
@@ -920,7 +981,7 @@ class NIFObjectLoader
                     Ogre::ControllerValueRealPtr srcval((animflags&Nif::NiNode::AnimFlag_AutoPlay) ?
                                                         Ogre::ControllerManager::getSingleton().getFrameTimeSource() :
                                                         Ogre::ControllerValueRealPtr());
-                    Ogre::ControllerValueRealPtr dstval(OGRE_NEW KeyframeController::Value(trgtbone, key->data.getPtr()));
+                    Ogre::ControllerValueRealPtr dstval(KeyframeController::createValue(trgtbone, name, key->data.getPtr()));
                     KeyframeController::Function* function = OGRE_NEW KeyframeController::Function(key, (animflags&Nif::NiNode::AnimFlag_AutoPlay));
                     scene->mMaxControllerLength = std::max(function->mStopTime, scene->mMaxControllerLength);
                     Ogre::ControllerFunctionRealPtr func(function);
@@ -1159,7 +1220,7 @@ public:
 
             Ogre::Bone *trgtbone = skel->getBone(strdata->string);
             Ogre::ControllerValueRealPtr srcval;
-            Ogre::ControllerValueRealPtr dstval(OGRE_NEW KeyframeController::Value(trgtbone, key->data.getPtr()));
+            Ogre::ControllerValueRealPtr dstval(KeyframeController::createValue(trgtbone, name, key->data.getPtr()));
             Ogre::ControllerFunctionRealPtr func(OGRE_NEW KeyframeController::Function(key, false));
 
             ctrls.push_back(Ogre::Controller<Ogre::Real>(srcval, dstval, func));
@@ -1275,5 +1336,10 @@ void Loader::createKfControllers(Ogre::Entity *skelBase,
     NIFObjectLoader::loadKf(skelBase->getSkeleton(), name, textKeys, ctrls);
 }
 
+void Loader::setCompressKeyframes(bool compress)
+{
+    sCompressKeyframes = compress;
+}
+
 
 } // namespace NifOgre
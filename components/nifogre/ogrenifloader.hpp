@@ -107,6 +107,10 @@ public:
                                     const std::string &name,
                                     TextKeyMap &textKeys,
                                     std::vector<Ogre::Controller<Ogre::Real> > &ctrls);
+
+    /// Share one compact copy of the keyframes of each animation between all
+    /// controllers using it, instead of copying the full keys into each one.
+    static void setCompressKeyframes(bool compress);
 };
 
 // FIXME: Should be with other general Ogre extensions.
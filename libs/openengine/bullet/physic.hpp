@@ -207,6 +207,12 @@ namespace Physic
             float scale, const Ogre::Vector3 &position, const Ogre::Quaternion &rotation,
             Ogre::Vector3* scaledBoxTranslation = 0, Ogre::Quaternion* boxRotation = 0, bool raycasting=false, bool placeable=false);
 
+        /**
+         * Loads the collision shape of a mesh at the given scale, so that creating
+         * a body with it later doesn't have to build it.
+         */
+        void prepareShape(const std::string &mesh, float scale);
+
         /**
          * Adjusts a rigid body to the right position and rotation
          */